@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "raycast.h"
+#include "harness.h"
+#include "bench.h"
+
+// Type definitions
+typedef struct bench_case bench_case;
+
+// One scene of the suite: how to generate it and how to render it
+struct bench_case
+{
+   const char *name;
+   void (*generate)(FILE *out, int size);
+   int size;
+   int width;
+   int height;
+   const char *extra;
+};
+
+// The suite, from small scenes to large ones. Sizes are grid width, sphere
+// count, light count and stack height; the basic scene ignores its size.
+static const bench_case cases[] =
+{
+   { "grid-100", write_grid, 10, 400, 400, NULL },
+   { "grid-10k", write_grid, 100, 400, 400, NULL },
+   { "cloud-1k", write_cloud, 1000, 400, 400, NULL },
+   { "cloud-20k", write_cloud, 20000, 400, 400, NULL },
+   { "cloud-100k", write_cloud, 100000, 400, 400, NULL },
+   { "lights-16", write_lights, 16, 300, 300, NULL },
+   { "lights-64", write_lights, 64, 300, 300, NULL },
+   { "stack-8", write_stack, 8, 300, 300, "--max-depth=16" },
+   { "stack-32", write_stack, 32, 300, 300, "--max-depth=20" },
+   { "basic-1080p", write_basic, 1, 1920, 1080, NULL },
+   { "basic-2160p", write_basic, 1, 3840, 2160, NULL }
+};
+
+// State of the generators' random numbers, reset for every scene so each one
+// comes out the same whatever else is generated
+static unsigned int random_state = BENCH_SEED;
+
+// Forward declarations
+double bench_random(double low, double high);
+void write_camera(FILE *out);
+void write_sphere(FILE *out, ib_v3 *position, float radius, ib_v3 *color, float reflectivity, float refractivity);
+void write_plane(FILE *out, ib_v3 *position, ib_v3 *normal, ib_v3 *color, float reflectivity);
+void write_light(FILE *out, ib_v3 *position, float intensity, ib_v3 *direction);
+bool generate_case(const bench_case *cur_case, char *scene_name);
+bool run_case(const bench_case *cur_case, char **base_args, char *scene_name, run_report *result);
+void print_result(const bench_case *cur_case, run_report *result, int format);
+
+int main(int argc, char *argv[])
+{
+   // Variable declarations
+   char *raytrace = BENCH_RAYTRACE;
+   char *only = NULL;
+   char *threads = NULL;
+   char *base_args[BENCH_MAX_ARGS];
+   char scene_name[BENCH_PATH_LEN];
+   run_report result;
+   int runs = BENCH_RUNS;
+   int format = BENCH_FORMAT_TEXT;
+   int failed = 0;
+
+   // Read the optional settings
+   for (int index = 1; index < argc; index++)
+   {
+      if (strncmp(argv[index], "--raytrace=", strlen("--raytrace=")) == 0)
+      {
+         raytrace = argv[index] + strlen("--raytrace=");
+      }
+      else if (strncmp(argv[index], "--runs=", strlen("--runs=")) == 0 && atoi(argv[index] + strlen("--runs=")) > 0)
+      {
+         runs = atoi(argv[index] + strlen("--runs="));
+      }
+      else if (strncmp(argv[index], "--only=", strlen("--only=")) == 0)
+      {
+         only = argv[index] + strlen("--only=");
+      }
+      else if (strncmp(argv[index], "--threads=", strlen("--threads=")) == 0)
+      {
+         threads = argv[index];
+      }
+      else if (strcmp(argv[index], "--format=csv") == 0)
+      {
+         format = BENCH_FORMAT_CSV;
+      }
+      else if (strcmp(argv[index], "--format=text") == 0)
+      {
+         format = BENCH_FORMAT_TEXT;
+      }
+      else
+      {
+         fprintf(stderr, "Usage: %s [--raytrace=PATH] [--runs=N] [--only=PREFIX] [--threads=N] [--format=text|csv]\n", argv[0]);
+         return RUN_FAIL;
+      }
+   }
+
+   // Every run passes the same renderer and settings
+   base_args[0] = raytrace;
+   base_args[1] = threads;
+
+   // Start the report
+   mkdir(BENCH_DIR, 0755);
+   if (format == BENCH_FORMAT_CSV)
+   {
+      printf("scene,width,height,parse_ms,render_ms,write_ms,total_ms,rays,mrays_per_s,peak_rss_kb\n");
+   }
+   else
+   {
+      printf("%-12s %11s %9s %10s %9s %10s %11s %9s %8s\n", "scene", "pixels", "parse ms", "render ms", "write ms",
+             "total ms", "rays", "Mrays/s", "peak MB");
+   }
+
+   // Generate and render every case, keeping the best timing of its runs
+   for (size_t index = 0; index < sizeof(cases) / sizeof(bench_case); index++)
+   {
+      // Skip the cases that were not asked for
+      if (only != NULL && strncmp(cases[index].name, only, strlen(only)) != 0)
+      {
+         continue;
+      }
+
+      // Render the scene runs times
+      memset(&result, 0, sizeof(run_report));
+      if (generate_case(&cases[index], scene_name) == FALSE)
+      {
+         fprintf(stderr, "Error: Could not write scene \"%s\".\n", scene_name);
+         return RUN_FAIL;
+      }
+      for (int run = 0; run < runs; run++)
+      {
+         if (run_case(&cases[index], base_args, scene_name, &result) == FALSE)
+         {
+            fprintf(stderr, "Error: %s failed on \"%s\"; see %s/%s.log\n", raytrace, scene_name, BENCH_DIR, cases[index].name);
+            failed++;
+            break;
+         }
+      }
+
+      print_result(&cases[index], &result, format);
+      fflush(stdout);
+   }
+
+   return failed == 0 ? RUN_SUCCESS : RUN_FAIL;
+}
+
+// Helper method used to draw a seeded random number between low and high
+double bench_random(double low, double high)
+{
+   // Step the xorshift state
+   random_state ^= random_state << 13;
+   random_state ^= random_state >> 17;
+   random_state ^= random_state << 5;
+
+   return low + (high - low) * (random_state / 4294967296.0);
+}
+
+// Helper method used to write the camera every scene shares
+void write_camera(FILE *out)
+{
+   fprintf(out, "camera, width: 2.0, height: 2.0\n");
+}
+
+// Helper method used to write one sphere, with a reflect/refract/ior trio when it has either
+void write_sphere(FILE *out, ib_v3 *position, float radius, ib_v3 *color, float reflectivity, float refractivity)
+{
+   fprintf(out, "sphere, position: [%.3f, %.3f, %.3f], radius: %.3f, specular_color: [1, 1, 1], diffuse_color: [%.2f, %.2f, %.2f]",
+           position->x, position->y, position->z, radius, color->x, color->y, color->z);
+   if (reflectivity > 0 || refractivity > 0)
+   {
+      fprintf(out, ", reflectivity: %.2f, refractivity: %.2f, ior: 1.5", reflectivity, refractivity);
+   }
+   fprintf(out, "\n");
+}
+
+// Helper method used to write one plane
+void write_plane(FILE *out, ib_v3 *position, ib_v3 *normal, ib_v3 *color, float reflectivity)
+{
+   fprintf(out, "plane, position: [%.3f, %.3f, %.3f], normal: [%.3f, %.3f, %.3f], diffuse_color: [%.2f, %.2f, %.2f]",
+           position->x, position->y, position->z, normal->x, normal->y, normal->z, color->x, color->y, color->z);
+   if (reflectivity > 0)
+   {
+      fprintf(out, ", reflectivity: %.2f, refractivity: 0.0, ior: 1.0", reflectivity);
+   }
+   fprintf(out, "\n");
+}
+
+// Helper method used to write one light, a spot light when it has a direction
+void write_light(FILE *out, ib_v3 *position, float intensity, ib_v3 *direction)
+{
+   fprintf(out, "light, color: [%.3f, %.3f, %.3f], radial-a2: 0.001, radial-a1: 0.01, radial-a0: 0.5, position: [%.3f, %.3f, %.3f]",
+           intensity, intensity, intensity, position->x, position->y, position->z);
+   if (direction != NULL)
+   {
+      fprintf(out, ", theta: 30, direction: [%.3f, %.3f, %.3f], angular-a0: 0.5", direction->x, direction->y, direction->z);
+   }
+   else
+   {
+      fprintf(out, ", theta: 0");
+   }
+   fprintf(out, "\n");
+}
+
+// Method used to write a size by size grid of spheres facing the camera over a floor
+void write_grid(FILE *out, int size)
+{
+   // Variable declarations
+   float spacing = 16.0 / size;
+   ib_v3 floor = { 0, -9, 0 };
+   ib_v3 up = { 0, 1, 0 };
+   ib_v3 gray = { 0.5, 0.5, 0.5 };
+   ib_v3 light_a = { 0, 12, -10 };
+   ib_v3 light_b = { -10, 5, 0 };
+
+   write_camera(out);
+   for (int row = 0; row < size; row++)
+   {
+      for (int col = 0; col < size; col++)
+      {
+         // Variable declarations
+         ib_v3 position = { -8 + spacing * (col + 0.5), -8 + spacing * (row + 0.5), -20 };
+         ib_v3 color = { (float)col / size, (float)row / size, 0.5 };
+
+         write_sphere(out, &position, spacing * 0.4, &color, (row + col) % 4 == 0 ? 0.3 : 0, 0);
+      }
+   }
+   write_plane(out, &floor, &up, &gray, 0);
+   write_light(out, &light_a, 2, NULL);
+   write_light(out, &light_b, 1, NULL);
+}
+
+// Method used to write a random cloud of size spheres, a quarter of them
+// reflective, shrinking the spheres as the count grows to keep the coverage alike
+void write_cloud(FILE *out, int size)
+{
+   // Variable declarations
+   float scale = cbrt(1000.0 / size);
+   ib_v3 floor = { 0, -25, 0 };
+   ib_v3 up = { 0, 1, 0 };
+   ib_v3 gray = { 0.4, 0.4, 0.4 };
+   ib_v3 light_a = { 10, 30, -20 };
+   ib_v3 light_b = { -20, 10, 0 };
+
+   random_state = BENCH_SEED;
+   write_camera(out);
+   for (int index = 0; index < size; index++)
+   {
+      // Variable declarations
+      ib_v3 position;
+      ib_v3 color;
+
+      position.x = bench_random(-30, 30);
+      position.y = bench_random(-20, 20);
+      position.z = bench_random(-90, -30);
+      color.x = bench_random(0, 1);
+      color.y = bench_random(0, 1);
+      color.z = bench_random(0, 1);
+      write_sphere(out, &position, bench_random(0.4, 1.6) * scale, &color, index % 4 == 0 ? 0.5 : 0, 0);
+   }
+   write_plane(out, &floor, &up, &gray, 0);
+   write_light(out, &light_a, 3, NULL);
+   write_light(out, &light_b, 2, NULL);
+}
+
+// Method used to write a grid of spheres lit by size lights in a ring above
+// them, every other one a spot light aimed at the middle
+void write_lights(FILE *out, int size)
+{
+   // Variable declarations
+   ib_v3 floor = { 0, -5, 0 };
+   ib_v3 up = { 0, 1, 0 };
+   ib_v3 gray = { 0.6, 0.6, 0.6 };
+   ib_v3 target = { 0, -3, -15 };
+
+   write_camera(out);
+   for (int row = 0; row < 8; row++)
+   {
+      for (int col = 0; col < 8; col++)
+      {
+         // Variable declarations
+         ib_v3 position = { -7 + 2 * col, -4, -8 - 2 * row };
+         ib_v3 color = { 0.8, (float)col / 8, (float)row / 8 };
+
+         write_sphere(out, &position, 0.8, &color, 0, 0);
+      }
+   }
+   write_plane(out, &floor, &up, &gray, 0);
+   for (int index = 0; index < size; index++)
+   {
+      // Variable declarations
+      double angle = 2 * M_PI * index / size;
+      ib_v3 position = { 12 * cos(angle), 6, -15 + 12 * sin(angle) };
+      ib_v3 direction = { target.x - position.x, target.y - position.y, target.z - position.z };
+
+      write_light(out, &position, 8.0 / size, index % 2 == 1 ? &direction : NULL);
+   }
+}
+
+// Method used to write a helix of size spheres running away from the camera,
+// alternately mirrored and glass, between two facing mirrors so rays keep bouncing
+void write_stack(FILE *out, int size)
+{
+   // Variable declarations
+   ib_v3 left = { -3, 0, 0 };
+   ib_v3 right = { 3, 0, 0 };
+   ib_v3 toward_right = { 1, 0, 0 };
+   ib_v3 toward_left = { -1, 0, 0 };
+   ib_v3 floor = { 0, -3, 0 };
+   ib_v3 up = { 0, 1, 0 };
+   ib_v3 gray = { 0.3, 0.3, 0.3 };
+   ib_v3 light = { 0, 2.5, -2 };
+
+   write_camera(out);
+   for (int index = 0; index < size; index++)
+   {
+      // Variable declarations
+      ib_v3 position = { 1.2 * cos(index * 0.7), 1.2 * sin(index * 0.7), -4 - 1.5 * index };
+      ib_v3 color = { 0.2, 0.3, 0.9 };
+
+      write_sphere(out, &position, 0.8, &color, index % 2 == 0 ? 0.8 : 0.1, index % 2 == 0 ? 0 : 0.8);
+   }
+   write_plane(out, &left, &toward_right, &gray, 0.9);
+   write_plane(out, &right, &toward_left, &gray, 0.9);
+   write_plane(out, &floor, &up, &gray, 0.5);
+   write_light(out, &light, 3, NULL);
+}
+
+// Method used to write the sample scene, for timing large resolutions
+void write_basic(FILE *out, int size)
+{
+   fprintf(out, "camera, width: 2.0, height: 2.0\n");
+   fprintf(out, "sphere, position: [1, 1, -5], radius: 2.0, specular_color: [1, 1, 1], diffuse_color: [1, 0, 0], "
+                "reflectivity: 0.3, refractivity: 0.2, ior: 1.33\n");
+   fprintf(out, "plane, position: [0, -1, 0], normal: [0, 1, 0], diffuse_color: [0, 0.5, 0.5], color: [0, 1, 0], "
+                "reflectivity: 0.3, refractivity: 0.2, ior: 1.33\n");
+   fprintf(out, "light, color: [3, 3, 3], theta: 0, radial-a2: 0.15, radial-a1: 0.15, radial-a0: 0.15, position: [1, 3, -1]\n");
+}
+
+// Helper method used to write the scene of a case into the bench directory
+bool generate_case(const bench_case *cur_case, char *scene_name)
+{
+   // Variable declarations
+   FILE *out;
+
+   snprintf(scene_name, BENCH_PATH_LEN, "%s/%s.csv", BENCH_DIR, cur_case->name);
+   out = fopen(scene_name, "w");
+   if (out == NULL)
+   {
+      return FALSE;
+   }
+
+   cur_case->generate(out, cur_case->size);
+   return fclose(out) == 0;
+}
+
+// Helper method used to render a case once with --stats=text, folding its
+// timings into the best of the case's runs
+bool run_case(const bench_case *cur_case, char **base_args, char *scene_name, run_report *result)
+{
+   // Variable declarations
+   char width[BENCH_LINE_LEN];
+   char height[BENCH_LINE_LEN];
+   char output_name[BENCH_PATH_LEN];
+   char log_name[BENCH_PATH_LEN];
+   char *args[BENCH_MAX_ARGS];
+   int arg_count = 0;
+   run_report run;
+
+   // Build the renderer's arguments
+   snprintf(width, sizeof(width), "%d", cur_case->width);
+   snprintf(height, sizeof(height), "%d", cur_case->height);
+   snprintf(output_name, sizeof(output_name), "%s/%s.ppm", BENCH_DIR, cur_case->name);
+   snprintf(log_name, sizeof(log_name), "%s/%s.log", BENCH_DIR, cur_case->name);
+   args[arg_count++] = base_args[0];
+   args[arg_count++] = width;
+   args[arg_count++] = height;
+   args[arg_count++] = scene_name;
+   args[arg_count++] = output_name;
+   args[arg_count++] = "--stats=text";
+   if (base_args[1] != NULL)
+   {
+      args[arg_count++] = base_args[1];
+   }
+   if (cur_case->extra != NULL)
+   {
+      args[arg_count++] = (char *)cur_case->extra;
+   }
+   args[arg_count] = NULL;
+
+   if (run_raytrace(args, log_name, &run) == FALSE)
+   {
+      return FALSE;
+   }
+
+   keep_best(result, &run);
+   return TRUE;
+}
+
+// Helper method used to print one row of the report. Throughput counts
+// primary, secondary and shadow rays over the render phase, so it needs a
+// renderer built with counters.
+void print_result(const bench_case *cur_case, run_report *result, int format)
+{
+   // Variable declarations
+   double mrays = result->counted == TRUE && result->render_ms > 0 ? result->rays / (result->render_ms * 1000.0) : 0;
+
+   if (format == BENCH_FORMAT_CSV)
+   {
+      printf("%s,%d,%d,%.3f,%.3f,%.3f,%.3f,%ld,%.3f,%ld\n", cur_case->name, cur_case->width, cur_case->height, result->parse_ms,
+             result->render_ms, result->write_ms, result->total_ms, result->rays, mrays, result->peak_kb);
+   }
+   else
+   {
+      printf("%-12s %5dx%-5d %9.2f %10.2f %9.2f %10.2f %11ld %9.2f %8.1f\n", cur_case->name, cur_case->width, cur_case->height,
+             result->parse_ms, result->render_ms, result->write_ms, result->total_ms, result->rays, mrays, result->peak_kb / 1024.0);
+   }
+}
@@ -0,0 +1,24 @@
+#ifndef BENCH
+#define BENCH
+
+#include "raycast.h"
+
+#define BENCH_RAYTRACE "./raytrace"
+#define BENCH_DIR "bench_scenes"
+#define BENCH_RUNS 3
+#define BENCH_SEED 12345u
+#define BENCH_PATH_LEN 256
+#define BENCH_LINE_LEN 256
+#define BENCH_MAX_ARGS 16
+
+#define BENCH_FORMAT_TEXT 0
+#define BENCH_FORMAT_CSV 1
+
+// Public function declarations
+void write_grid(FILE *out, int size);
+void write_cloud(FILE *out, int size);
+void write_lights(FILE *out, int size);
+void write_stack(FILE *out, int size);
+void write_basic(FILE *out, int size);
+
+#endif
@@ -0,0 +1,583 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ib_3dmath.h"
+#include "raycast.h"
+#include "bvh.h"
+#include "intersect.h"
+#include "stats.h"
+
+// Forward declarations
+void subdivide(bvh *tree, int node_index, int depth, aabb *bounds, ib_v3 *centroids, int *order);
+void grow_box(aabb *box, aabb *other);
+float box_area(aabb *box);
+int leaf_batches(int count);
+bool ray_box(ib_v3 *r0, ib_v3 *inv_rd, aabb *box, float max_t, float *entry);
+void closest_subtree(scene *scn, frame_terms *frame, int root, ib_v3 *r0, ib_v3 *rd, ib_v3 *inv_rd, float *t, int *hit);
+bool cone_box(ib_v3 *origin, tile_cone *cone, aabb *box, float *near);
+
+// Method used to build a SAH bvh over a set of spheres. On return order holds
+// the sphere indices in leaf order, so each leaf covers a contiguous range once
+// the caller has permuted its arrays.
+void build_bvh(bvh *tree, sphere_set *spheres, int *order)
+{
+   // Variable declarations
+   aabb *bounds;
+   ib_v3 *centroids;
+   int index;
+
+   // Start with an empty tree
+   memset(tree, 0, sizeof(bvh));
+
+   // Nothing to build if there are no spheres
+   if (spheres->count == 0)
+   {
+      return;
+   }
+
+   // Store the bounds and centroid of every sphere
+   bounds = malloc(sizeof(aabb) * spheres->count);
+   centroids = malloc(sizeof(ib_v3) * spheres->count);
+   for (index = 0; index < spheres->count; index++)
+   {
+      float radius = sqrtf(spheres->radius2[index]);
+
+      centroids[index].x = spheres->x[index];
+      centroids[index].y = spheres->y[index];
+      centroids[index].z = spheres->z[index];
+      bounds[index].min.x = centroids[index].x - radius;
+      bounds[index].min.y = centroids[index].y - radius;
+      bounds[index].min.z = centroids[index].z - radius;
+      bounds[index].max.x = centroids[index].x + radius;
+      bounds[index].max.y = centroids[index].y + radius;
+      bounds[index].max.z = centroids[index].z + radius;
+      order[index] = index;
+   }
+
+   // A binary tree over n primitives never needs more than 2n - 1 nodes
+   tree->nodes = malloc(sizeof(bvh_node) * 2 * spheres->count);
+   tree->nodes[0].left_first = 0;
+   tree->nodes[0].count = spheres->count;
+   tree->node_count = 1;
+   subdivide(tree, 0, 0, bounds, centroids, order);
+
+   // Release build data
+   free(bounds);
+   free(centroids);
+}
+
+// Helper method used to release the memory held by a bvh
+void free_bvh(bvh *tree)
+{
+   free(tree->nodes);
+   memset(tree, 0, sizeof(bvh));
+}
+
+// Helper method used to recursively split a node using binned SAH
+void subdivide(bvh *tree, int node_index, int depth, aabb *bounds, ib_v3 *centroids, int *order)
+{
+   // Variable declarations
+   bvh_node *node = &(tree->nodes[node_index]);
+   int first = node->left_first;
+   int count = node->count;
+   aabb centroid_box;
+   aabb bins[BVH_BINS];
+   int bin_counts[BVH_BINS];
+   float best_cost = INFINITY;
+   int best_axis = -1;
+   int best_split = 0;
+   int mid;
+   int index;
+
+   // Calculate the node bounds and the bounds of the primitive centroids
+   node->bounds = bounds[order[first]];
+   centroid_box.min = centroids[order[first]];
+   centroid_box.max = centroids[order[first]];
+   for (index = first + 1; index < first + count; index++)
+   {
+      aabb point = { centroids[order[index]], centroids[order[index]] };
+      grow_box(&(node->bounds), &bounds[order[index]]);
+      grow_box(&centroid_box, &point);
+   }
+
+   // Small nodes are always leaves
+   if (count <= 2)
+   {
+      return;
+   }
+
+   // Find the cheapest split plane over each axis
+   for (int axis = 0; axis < 3; axis++)
+   {
+      float lo = ((float *)&centroid_box.min)[axis];
+      float hi = ((float *)&centroid_box.max)[axis];
+      float scale;
+      aabb left_box;
+      aabb right_boxes[BVH_BINS];
+      int right_counts[BVH_BINS];
+      int left_count = 0;
+
+      // Skip axis if all centroids lie on the same plane
+      if (hi <= lo)
+      {
+         continue;
+      }
+
+      // Reset bins
+      for (int bin = 0; bin < BVH_BINS; bin++)
+      {
+         bin_counts[bin] = 0;
+      }
+
+      // Drop each primitive into a bin along this axis
+      scale = BVH_BINS / (hi - lo);
+      for (index = first; index < first + count; index++)
+      {
+         int bin = (int)((((float *)&centroids[order[index]])[axis] - lo) * scale);
+         if (bin >= BVH_BINS)
+         {
+            bin = BVH_BINS - 1;
+         }
+
+         // Grow bin bounds
+         if (bin_counts[bin] == 0)
+         {
+            bins[bin] = bounds[order[index]];
+         }
+         else
+         {
+            grow_box(&bins[bin], &bounds[order[index]]);
+         }
+         bin_counts[bin]++;
+      }
+
+      // Sweep from the right to collect suffix bounds
+      right_counts[BVH_BINS - 1] = bin_counts[BVH_BINS - 1];
+      right_boxes[BVH_BINS - 1] = bins[BVH_BINS - 1];
+      for (int bin = BVH_BINS - 2; bin >= 0; bin--)
+      {
+         right_counts[bin] = right_counts[bin + 1] + bin_counts[bin];
+         right_boxes[bin] = right_boxes[bin + 1];
+         if (bin_counts[bin] > 0)
+         {
+            if (right_counts[bin + 1] == 0)
+            {
+               right_boxes[bin] = bins[bin];
+            }
+            else
+            {
+               grow_box(&right_boxes[bin], &bins[bin]);
+            }
+         }
+      }
+
+      // Sweep from the left and evaluate the cost of splitting after each bin
+      for (int bin = 0; bin < BVH_BINS - 1; bin++)
+      {
+         if (bin_counts[bin] > 0)
+         {
+            if (left_count == 0)
+            {
+               left_box = bins[bin];
+            }
+            else
+            {
+               grow_box(&left_box, &bins[bin]);
+            }
+            left_count += bin_counts[bin];
+         }
+
+         // Only consider splits that leave primitives on both sides
+         if (left_count > 0 && right_counts[bin + 1] > 0)
+         {
+            float cost = leaf_batches(left_count) * box_area(&left_box) +
+                         leaf_batches(right_counts[bin + 1]) * box_area(&right_boxes[bin + 1]);
+
+            if (cost < best_cost)
+            {
+               best_cost = cost;
+               best_axis = axis;
+               best_split = bin;
+            }
+         }
+      }
+   }
+
+   // Compare the best split against the cost of keeping this node as a leaf
+   best_cost = BVH_TRAVERSAL_COST + BVH_INTERSECT_COST * best_cost / box_area(&(node->bounds));
+   if (count <= BVH_MAX_LEAF && (best_axis < 0 || best_cost >= BVH_INTERSECT_COST * leaf_batches(count)))
+   {
+      return;
+   }
+
+   // Split the range in half if the centroids are all identical or the tree is too deep
+   if (best_axis < 0 || depth >= BVH_MAX_DEPTH)
+   {
+      mid = first + count / 2;
+   }
+   // Otherwise, partition the primitives around the chosen split plane
+   else
+   {
+      float lo = ((float *)&centroid_box.min)[best_axis];
+      float scale = BVH_BINS / (((float *)&centroid_box.max)[best_axis] - lo);
+      int left = first;
+      int right = first + count - 1;
+
+      while (left <= right)
+      {
+         int bin = (int)((((float *)&centroids[order[left]])[best_axis] - lo) * scale);
+         if (bin >= BVH_BINS)
+         {
+            bin = BVH_BINS - 1;
+         }
+
+         // Keep primitive on the left, or swap it to the right side
+         if (bin <= best_split)
+         {
+            left++;
+         }
+         else
+         {
+            int swap = order[left];
+            order[left] = order[right];
+            order[right] = swap;
+            right--;
+         }
+      }
+      mid = left;
+   }
+
+   // Create both children next to each other and recurse
+   int left_child = tree->node_count;
+   tree->node_count += 2;
+   tree->nodes[left_child].left_first = first;
+   tree->nodes[left_child].count = mid - first;
+   tree->nodes[left_child + 1].left_first = mid;
+   tree->nodes[left_child + 1].count = first + count - mid;
+
+   // Turn the current node into an interior node
+   node->left_first = left_child;
+   node->count = 0;
+
+   subdivide(tree, left_child, depth + 1, bounds, centroids, order);
+   subdivide(tree, left_child + 1, depth + 1, bounds, centroids, order);
+}
+
+// Method used to find the closest primitive hit by a ray
+void bvh_closest(scene *scn, ib_v3 *r0, ib_v3 *rd, float *t, int *hit)
+{
+   // Variable declarations
+   bvh *tree = &(scn->tree);
+   ib_v3 inv_rd = { 1.0 / rd->x, 1.0 / rd->y, 1.0 / rd->z };
+   float entry;
+
+   // Start with no hit
+   *t = INFINITY;
+   *hit = -1;
+
+   // Walk the tree front to back, skipping nodes beyond the closest hit
+   if (tree->node_count > 0 && ray_box(r0, &inv_rd, &(tree->nodes[0].bounds), *t, &entry))
+   {
+      closest_subtree(scn, NULL, 0, r0, rd, &inv_rd, t, hit);
+   }
+
+   // Planes are unbounded, so test them directly
+   planes_closest(&(scn->planes), scn->spheres.count, r0, rd, t, hit);
+}
+
+// Method used to find the closest primitive hit by a primary ray of a tile. Only
+// the subtrees found by bvh_cone_entries are walked, nearest first, and the
+// origin terms come from the frame.
+void bvh_closest_entries(scene *scn, frame_terms *frame, tile_entry *entries, int entry_count, ib_v3 *rd, float *t, int *hit)
+{
+   // Variable declarations
+   ib_v3 inv_rd = { 1.0 / rd->x, 1.0 / rd->y, 1.0 / rd->z };
+   float entry;
+
+   // Start with no hit
+   *t = INFINITY;
+   *hit = -1;
+
+   // Stop at the first subtree that starts beyond the closest hit
+   for (int index = 0; index < entry_count && entries[index].near <= *t; index++)
+   {
+      if (ray_box(&(frame->origin), &inv_rd, &(scn->tree.nodes[entries[index].node].bounds), *t, &entry))
+      {
+         closest_subtree(scn, frame, entries[index].node, &(frame->origin), rd, &inv_rd, t, hit);
+      }
+   }
+
+   // Planes are unbounded, so test them directly
+   planes_closest_frame(frame, &(scn->planes), scn->spheres.count, rd, t, hit);
+}
+
+// Method used to find the subtrees a tile's primary rays can enter. Starting
+// from the root, nodes are split into the children that touch the tile's cone
+// until there are BVH_TILE_ENTRIES subtrees or only leaves are left. Nothing
+// outside the cone can be hit by a ray of the tile, so culling never changes a
+// result. Returns the number of entries, sorted nearest first.
+int bvh_cone_entries(scene *scn, ib_v3 *origin, tile_cone *cone, tile_entry *entries)
+{
+   // Variable declarations
+   bvh *tree = &(scn->tree);
+   int count = 0;
+   bool split;
+   float near;
+
+   // Start from the root if the cone reaches it at all
+   if (tree->node_count > 0 && cone_box(origin, cone, &(tree->nodes[0].bounds), &near))
+   {
+      entries[count].node = 0;
+      entries[count++].near = near;
+   }
+
+   // Keep splitting interior entries while there is room
+   do
+   {
+      split = FALSE;
+      for (int index = 0; index < count && count < BVH_TILE_ENTRIES; index++)
+      {
+         // Variable declarations
+         bvh_node *node = &(tree->nodes[entries[index].node]);
+         int kept = 0;
+
+         // Leaves stay as they are
+         if (node->count > 0)
+         {
+            continue;
+         }
+
+         // Replace the entry with whichever children touch the cone
+         for (int child = node->left_first; child <= node->left_first + 1; child++)
+         {
+            if (cone_box(origin, cone, &(tree->nodes[child].bounds), &near))
+            {
+               // Variable declarations
+               int slot = kept == 0 ? index : count++;
+
+               entries[slot].node = child;
+               entries[slot].near = near;
+               kept++;
+            }
+         }
+
+         // Drop the entry if neither child does, and look at whatever moved into its place
+         if (kept == 0)
+         {
+            entries[index--] = entries[--count];
+         }
+         split = TRUE;
+      }
+   } while (split == TRUE && count < BVH_TILE_ENTRIES);
+
+   // Sort nearest first so rays can stop early
+   for (int index = 1; index < count; index++)
+   {
+      // Variable declarations
+      tile_entry cur = entries[index];
+      int slot = index;
+
+      while (slot > 0 && entries[slot - 1].near > cur.near)
+      {
+         entries[slot] = entries[slot - 1];
+         slot--;
+      }
+      entries[slot] = cur;
+   }
+
+   return count;
+}
+
+// Helper method used to walk a subtree whose root the ray already enters, front
+// to back, skipping nodes beyond the closest hit. With a frame, the origin terms
+// of the sphere tests are read from it instead of being worked out.
+void closest_subtree(scene *scn, frame_terms *frame, int root, ib_v3 *r0, ib_v3 *rd, ib_v3 *inv_rd, float *t, int *hit)
+{
+   // Variable declarations
+   bvh *tree = &(scn->tree);
+   int stack[BVH_STACK_SIZE];
+   int stack_size = 0;
+
+   stack[stack_size++] = root;
+   while (stack_size > 0)
+   {
+      bvh_node *node = &(tree->nodes[stack[--stack_size]]);
+
+      // Test every sphere in a leaf at once, keeping the lowest id on ties
+      if (node->count > 0)
+      {
+         if (frame != NULL)
+         {
+            spheres_closest_frame(frame, &(scn->spheres), node->left_first, node->count, rd, t, hit);
+         }
+         else
+         {
+            spheres_closest(&(scn->spheres), node->left_first, node->count, r0, rd, t, hit);
+         }
+      }
+      // Otherwise, push children so the nearest one is visited first
+      else
+      {
+         float near_entry;
+         float far_entry;
+         int near = node->left_first;
+         int far = node->left_first + 1;
+         bool near_hit = ray_box(r0, inv_rd, &(tree->nodes[near].bounds), *t, &near_entry);
+         bool far_hit = ray_box(r0, inv_rd, &(tree->nodes[far].bounds), *t, &far_entry);
+
+         // Swap so near really is the closer child
+         if (near_hit && far_hit && far_entry < near_entry)
+         {
+            int swap = near;
+            near = far;
+            far = swap;
+         }
+         else if (far_hit && !near_hit)
+         {
+            near = far;
+            near_hit = TRUE;
+            far_hit = FALSE;
+         }
+
+         if (far_hit)
+         {
+            stack[stack_size++] = far;
+         }
+         if (near_hit)
+         {
+            stack[stack_size++] = near;
+         }
+      }
+   }
+}
+
+// Method used to determine if any primitive other than skip blocks a ray before
+// dist, stopping at the first one found. blocker gets its id, or -1.
+bool bvh_occluded(scene *scn, ib_v3 *r0, ib_v3 *rd, float *dist, int *skip, int *blocker)
+{
+   // Variable declarations
+   bvh *tree = &(scn->tree);
+   int stack[BVH_STACK_SIZE];
+   int stack_size = 0;
+   ib_v3 inv_rd = { 1.0 / rd->x, 1.0 / rd->y, 1.0 / rd->z };
+   float entry;
+
+   // Planes are cheap and often block light, so test them first
+   if ((*blocker = planes_occluder(&(scn->planes), scn->spheres.count, r0, rd, *dist, *skip)) >= 0)
+   {
+      return TRUE;
+   }
+
+   // Walk the tree and stop at the first blocker
+   if (tree->node_count > 0 && ray_box(r0, &inv_rd, &(tree->nodes[0].bounds), *dist, &entry))
+   {
+      stack[stack_size++] = 0;
+   }
+   while (stack_size > 0)
+   {
+      bvh_node *node = &(tree->nodes[stack[--stack_size]]);
+
+      if (node->count > 0)
+      {
+         if ((*blocker = spheres_occluder(&(scn->spheres), node->left_first, node->count, r0, rd, *dist, *skip)) >= 0)
+         {
+            return TRUE;
+         }
+      }
+      else
+      {
+         // Order does not matter for an any-hit query
+         if (ray_box(r0, &inv_rd, &(tree->nodes[node->left_first].bounds), *dist, &entry))
+         {
+            stack[stack_size++] = node->left_first;
+         }
+         if (ray_box(r0, &inv_rd, &(tree->nodes[node->left_first + 1].bounds), *dist, &entry))
+         {
+            stack[stack_size++] = node->left_first + 1;
+         }
+      }
+   }
+
+   *blocker = -1;
+   return FALSE;
+}
+
+// Helper method used to grow a box so it contains another box
+void grow_box(aabb *box, aabb *other)
+{
+   box->min.x = fminf(box->min.x, other->min.x);
+   box->min.y = fminf(box->min.y, other->min.y);
+   box->min.z = fminf(box->min.z, other->min.z);
+   box->max.x = fmaxf(box->max.x, other->max.x);
+   box->max.y = fmaxf(box->max.y, other->max.y);
+   box->max.z = fmaxf(box->max.z, other->max.z);
+}
+
+// Helper method used to count the kernel calls needed to test a range of
+// spheres, since a full batch costs about as much as a single sphere
+int leaf_batches(int count)
+{
+   return (count + KERNEL_WIDTH - 1) / KERNEL_WIDTH;
+}
+
+// Helper method used to return half the surface area of a box
+float box_area(aabb *box)
+{
+   // Variable declarations
+   float dx = box->max.x - box->min.x;
+   float dy = box->max.y - box->min.y;
+   float dz = box->max.z - box->min.z;
+
+   return dx * dy + dy * dz + dz * dx;
+}
+
+// Helper method used to slab test a ray against a box within (0, max_t)
+bool ray_box(ib_v3 *r0, ib_v3 *inv_rd, aabb *box, float max_t, float *entry)
+{
+   // Variable declarations
+   float tx0 = (box->min.x - r0->x) * inv_rd->x;
+   float tx1 = (box->max.x - r0->x) * inv_rd->x;
+   float ty0 = (box->min.y - r0->y) * inv_rd->y;
+   float ty1 = (box->max.y - r0->y) * inv_rd->y;
+   float tz0 = (box->min.z - r0->z) * inv_rd->z;
+   float tz1 = (box->max.z - r0->z) * inv_rd->z;
+   float t_near = fmaxf(fmaxf(fminf(tx0, tx1), fminf(ty0, ty1)), fminf(tz0, tz1));
+   float t_far = fminf(fminf(fmaxf(tx0, tx1), fmaxf(ty0, ty1)), fmaxf(tz0, tz1));
+
+   // Store entry distance for front to back ordering
+   STAT_ADD(box_tests, 1);
+   *entry = t_near;
+
+   return t_far >= t_near && t_far > 0 && t_near <= max_t;
+}
+
+// Helper method used to check whether a box can touch a cone from origin, using
+// the sphere around the box and a small angular margin so rounding never culls
+// a box a ray could hit. near gets a lower bound on the distance to the box.
+bool cone_box(ib_v3 *origin, tile_cone *cone, aabb *box, float *near)
+{
+   // Variable declarations
+   double cx = (box->min.x + (double)box->max.x) / 2 - origin->x;
+   double cy = (box->min.y + (double)box->max.y) / 2 - origin->y;
+   double cz = (box->min.z + (double)box->max.z) / 2 - origin->z;
+   double dx = (double)box->max.x - box->min.x;
+   double dy = (double)box->max.y - box->min.y;
+   double dz = (double)box->max.z - box->min.z;
+   double radius = sqrt(dx * dx + dy * dy + dz * dz) / 2;
+   double dist = sqrt(cx * cx + cy * cy + cz * cz);
+   double cos_center;
+
+   // A box around the origin is always reached
+   if (dist <= radius)
+   {
+      *near = 0;
+      return TRUE;
+   }
+
+   // Compare the angle to the sphere's center with the cone plus the sphere's own angular size
+   *near = (dist - radius) * (1 - BVH_CONE_MARGIN);
+   cos_center = (cx * cone->axis_x + cy * cone->axis_y + cz * cone->axis_z) / dist;
+   cos_center = cos_center > 1 ? 1 : cos_center < -1 ? -1 : cos_center;
+   return acos(cos_center) - asin(radius / dist) <= cone->angle + BVH_CONE_MARGIN;
+}
@@ -0,0 +1,23 @@
+#ifndef BVH
+#define BVH
+
+#include "raycast.h"
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF KERNEL_WIDTH
+#define BVH_MAX_DEPTH 40
+#define BVH_STACK_SIZE 80
+#define BVH_TRAVERSAL_COST 1.0
+#define BVH_INTERSECT_COST 1.0
+#define BVH_TILE_ENTRIES 16
+#define BVH_CONE_MARGIN 1e-4
+
+// Public function declarations
+void build_bvh(bvh *tree, sphere_set *spheres, int *order);
+void free_bvh(bvh *tree);
+void bvh_closest(scene *scn, ib_v3 *r0, ib_v3 *rd, float *t, int *hit);
+bool bvh_occluded(scene *scn, ib_v3 *r0, ib_v3 *rd, float *dist, int *skip, int *blocker);
+void bvh_closest_entries(scene *scn, frame_terms *frame, tile_entry *entries, int entry_count, ib_v3 *rd, float *t, int *hit);
+int bvh_cone_entries(scene *scn, ib_v3 *origin, tile_cone *cone, tile_entry *entries);
+
+#endif
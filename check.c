@@ -0,0 +1,458 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "raycast.h"
+#include "scenefile.h"
+#include "harness.h"
+#include "check.h"
+
+// Type definitions
+typedef struct check_case check_case;
+typedef struct baseline_entry baseline_entry;
+
+// One render of the corpus and the image it must reproduce. Pixels may differ
+// from the golden image by up to tolerance levels in every channel.
+struct check_case
+{
+   const char *name;
+   const char *scene;
+   int width;
+   int height;
+   const char *extra[CHECK_MAX_EXTRA];
+   const char *golden;
+   int tolerance;
+   bool compile;
+};
+
+// Render time and ray count a case is held to
+struct baseline_entry
+{
+   char name[CHECK_NAME_LEN];
+   double render_ms;
+   long rays;
+};
+
+// The corpus. The sample scene is rendered every way that must leave its
+// committed image unchanged; pruning may move pixels by one level. Golden
+// images come from the recursive raycaster by make check-goldens, which
+// renders the check scenes the same way. The wavefront sums a pixel's bounces
+// in generation order rather than deepest first, so the deep stacks may be one
+// level off in a few pixels. plane-first lists a plane before two spheres;
+// the original shoot() kept a plane's negative t for a sphere the ray missed
+// and left rays that hit the next sphere black, which the bvh fixed.
+static const check_case cases[] =
+{
+   { "sample", "test.csv", 200, 200, { NULL }, "out.ppm", 0, FALSE },
+   { "sample-packet", "test.csv", 200, 200, { "--packet=4" }, "out.ppm", 0, FALSE },
+   { "sample-scalar", "test.csv", 200, 200, { "--isa=scalar" }, "out.ppm", 0, FALSE },
+   { "sample-sorted", "test.csv", 200, 200, { "--sort=on", "--threads=3", "--tile=7" }, "out.ppm", 0, FALSE },
+   { "sample-pruned", "test.csv", 200, 200, { "--prune=adaptive" }, "out.ppm", 1, FALSE },
+   { "stack", "check/stack.csv", 160, 120, { NULL }, "check/stack.ppm", 1, FALSE },
+   { "stack-once", "check/stack.csv", 160, 120, { "--shade=once" }, "check/stack-once.ppm", 1, FALSE },
+   { "lights", "check/lights.csv", 160, 120, { NULL }, "check/lights.ppm", 0, FALSE },
+   { "plane-first", "check/plane-first.csv", 160, 120, { NULL }, "check/plane-first.ppm", 0, FALSE },
+   { "cloud", "check/cloud.csv", 160, 120, { NULL }, "check/cloud.ppm", 0, FALSE },
+   { "cloud-compiled", "check/cloud.csv", 160, 120, { NULL }, "check/cloud.ppm", 0, TRUE }
+};
+
+// Forward declarations
+bool check_case_run(const check_case *cur_case, char *raytrace, int runs, run_report *measured);
+int compare_ms(const void *first, const void *second);
+bool compile_case(const check_case *cur_case, char *raytrace, char *scene_name);
+bool compare_images(char *output_name, const char *golden_name, int tolerance, int *differing, int *largest);
+unsigned char *read_ppm(const char *file_name, int *width, int *height);
+int load_baseline(baseline_entry *entries);
+baseline_entry *find_baseline(baseline_entry *entries, int count, const char *name);
+bool save_baseline(baseline_entry *entries, int count);
+
+int main(int argc, char *argv[])
+{
+   // Variable declarations
+   char *raytrace = CHECK_RAYTRACE;
+   char *only = NULL;
+   char output_name[CHECK_PATH_LEN];
+   int runs = CHECK_RUNS;
+   double slowdown = CHECK_SLOWDOWN_PCT;
+   double ray_slack = CHECK_RAY_SLACK_PCT;
+   bool update = FALSE;
+   baseline_entry baseline[CHECK_MAX_CASES];
+   int baseline_count;
+   int checked = 0;
+   int failed = 0;
+
+   // Read the optional settings
+   for (int index = 1; index < argc; index++)
+   {
+      if (strncmp(argv[index], "--raytrace=", strlen("--raytrace=")) == 0)
+      {
+         raytrace = argv[index] + strlen("--raytrace=");
+      }
+      else if (strncmp(argv[index], "--runs=", strlen("--runs=")) == 0 && atoi(argv[index] + strlen("--runs=")) > 0)
+      {
+         runs = atoi(argv[index] + strlen("--runs="));
+      }
+      else if (strncmp(argv[index], "--slowdown=", strlen("--slowdown=")) == 0 && atof(argv[index] + strlen("--slowdown=")) >= 0)
+      {
+         slowdown = atof(argv[index] + strlen("--slowdown="));
+      }
+      else if (strncmp(argv[index], "--ray-slack=", strlen("--ray-slack=")) == 0 && atof(argv[index] + strlen("--ray-slack=")) >= 0)
+      {
+         ray_slack = atof(argv[index] + strlen("--ray-slack="));
+      }
+      else if (strncmp(argv[index], "--only=", strlen("--only=")) == 0)
+      {
+         only = argv[index] + strlen("--only=");
+      }
+      else if (strcmp(argv[index], "--update") == 0)
+      {
+         update = TRUE;
+      }
+      else
+      {
+         fprintf(stderr, "Usage: %s [--raytrace=PATH] [--runs=N] [--slowdown=PCT] [--ray-slack=PCT] [--only=PREFIX] [--update]\n", argv[0]);
+         return RUN_FAIL;
+      }
+   }
+
+   // Renders go to their own directory, and are held to the stored baseline
+   mkdir(CHECK_OUT_DIR, 0755);
+   baseline_count = load_baseline(baseline);
+
+   // Render every case, comparing its image and then its speed
+   for (size_t index = 0; index < sizeof(cases) / sizeof(check_case); index++)
+   {
+      // Variable declarations
+      const check_case *cur_case = &cases[index];
+      baseline_entry *base = find_baseline(baseline, baseline_count, cur_case->name);
+      run_report measured;
+      bool passed = TRUE;
+      int differing;
+      int largest;
+
+      // Skip the cases that were not asked for
+      if (only != NULL && strncmp(cur_case->name, only, strlen(only)) != 0)
+      {
+         continue;
+      }
+      checked++;
+      printf("%-16s", cur_case->name);
+      fflush(stdout);
+
+      // A raycaster that fails to render fails the case outright
+      if (check_case_run(cur_case, raytrace, runs, &measured) == FALSE)
+      {
+         printf(" FAIL: %s did not render; see %s/%s.log\n", raytrace, CHECK_OUT_DIR, cur_case->name);
+         failed++;
+         continue;
+      }
+
+      // The image must match its golden image within the case's tolerance
+      snprintf(output_name, sizeof(output_name), "%s/%s.ppm", CHECK_OUT_DIR, cur_case->name);
+      if (compare_images(output_name, cur_case->golden, cur_case->tolerance, &differing, &largest) == FALSE && differing < 0)
+      {
+         printf(" image cannot be compared with %s", cur_case->golden);
+         passed = FALSE;
+      }
+      else if (differing > 0)
+      {
+         printf(" image differs from %s (%d pixels, up to %d levels)", cur_case->golden, differing, largest);
+         passed = FALSE;
+      }
+      else
+      {
+         printf(" image ok");
+      }
+
+      // The median render time may grow by slowdown percent, plus a little
+      // slack for timer noise on tiny renders
+      printf(", %.2f ms", measured.render_ms);
+      if (update == FALSE && base != NULL && measured.render_ms > base->render_ms * (1 + slowdown / 100) + CHECK_SLACK_MS)
+      {
+         printf(" (baseline %.2f ms, %+.0f%%, too slow)", base->render_ms, 100 * (measured.render_ms / base->render_ms - 1));
+         passed = FALSE;
+      }
+      else if (base != NULL)
+      {
+         printf(" (baseline %.2f ms, %+.0f%%)", base->render_ms, 100 * (measured.render_ms / base->render_ms - 1));
+      }
+
+      // Rays per frame do not depend on the machine or on timer noise, so
+      // they must match the baseline within ray_slack percent, which is none
+      // by default; fewer rays mean the baseline is out of date. A build
+      // without counters cannot be held to them, so it fails instead.
+      if (measured.counted == FALSE)
+      {
+         printf(", rays not counted, build with counters");
+         passed = FALSE;
+      }
+      else if (update == FALSE && base != NULL && base->rays >= 0 && measured.rays > base->rays * (1 + ray_slack / 100))
+      {
+         printf(", %ld rays (baseline %ld, too many)", measured.rays, base->rays);
+         passed = FALSE;
+      }
+      else if (update == FALSE && base != NULL && base->rays >= 0 && measured.rays < base->rays * (1 - ray_slack / 100))
+      {
+         printf(", %ld rays (baseline %ld, too few; update the baseline)", measured.rays, base->rays);
+         passed = FALSE;
+      }
+      else if (base != NULL && base->rays >= 0)
+      {
+         printf(", %ld rays (baseline %ld)", measured.rays, base->rays);
+      }
+      else
+      {
+         printf(", %ld rays", measured.rays);
+      }
+
+      printf(base == NULL && update == FALSE ? ", no baseline: %s\n" : ": %s\n", passed == TRUE ? "PASS" : "FAIL");
+      failed += passed == TRUE ? 0 : 1;
+
+      // When updating, replace the case's baseline or add one, keeping the other cases' as they are
+      if (update == TRUE && base == NULL && baseline_count < CHECK_MAX_CASES)
+      {
+         base = &baseline[baseline_count++];
+         snprintf(base->name, CHECK_NAME_LEN, "%s", cur_case->name);
+      }
+      if (update == TRUE && base != NULL)
+      {
+         base->render_ms = measured.render_ms;
+         base->rays = measured.counted == TRUE ? measured.rays : -1;
+      }
+   }
+
+   // Store the new baseline if asked, even if an image drifted, so the report says which
+   if (update == TRUE && save_baseline(baseline, baseline_count) == FALSE)
+   {
+      fprintf(stderr, "Error: Could not write %s.\n", CHECK_BASELINE);
+      return RUN_FAIL;
+   }
+
+   printf("%d of %d checks passed\n", checked - failed, checked);
+   return failed == 0 ? RUN_SUCCESS : RUN_FAIL;
+}
+
+// Helper method used to render a case runs times with --stats=text, keeping
+// the median render time, which one slow or lucky run cannot move the way it
+// moves the best. Compiled cases render the scene compiled beforehand.
+bool check_case_run(const check_case *cur_case, char *raytrace, int runs, run_report *measured)
+{
+   // Variable declarations
+   char width[CHECK_NAME_LEN];
+   char height[CHECK_NAME_LEN];
+   char scene_name[CHECK_PATH_LEN];
+   char output_name[CHECK_PATH_LEN];
+   char log_name[CHECK_PATH_LEN];
+   char *args[CHECK_MAX_ARGS];
+   int arg_count = 0;
+   double *times;
+
+   // Compile the scene first if the case renders the compiled format
+   snprintf(scene_name, sizeof(scene_name), "%s", cur_case->scene);
+   if (cur_case->compile == TRUE && compile_case(cur_case, raytrace, scene_name) == FALSE)
+   {
+      return FALSE;
+   }
+
+   // Build the raycaster's arguments
+   snprintf(width, sizeof(width), "%d", cur_case->width);
+   snprintf(height, sizeof(height), "%d", cur_case->height);
+   snprintf(output_name, sizeof(output_name), "%s/%s.ppm", CHECK_OUT_DIR, cur_case->name);
+   snprintf(log_name, sizeof(log_name), "%s/%s.log", CHECK_OUT_DIR, cur_case->name);
+   args[arg_count++] = raytrace;
+   args[arg_count++] = width;
+   args[arg_count++] = height;
+   args[arg_count++] = scene_name;
+   args[arg_count++] = output_name;
+   args[arg_count++] = "--stats=text";
+   for (int index = 0; index < CHECK_MAX_EXTRA && cur_case->extra[index] != NULL; index++)
+   {
+      args[arg_count++] = (char *)cur_case->extra[index];
+   }
+   args[arg_count] = NULL;
+
+   // Render it runs times; the work and ray count are the same every run
+   times = malloc(sizeof(double) * runs);
+   for (int rep = 0; rep < runs; rep++)
+   {
+      if (run_raytrace(args, log_name, measured) == FALSE)
+      {
+         free(times);
+         return FALSE;
+      }
+      times[rep] = measured->render_ms;
+   }
+
+   // Take the middle time, or the mean of the middle two
+   qsort(times, runs, sizeof(double), compare_ms);
+   measured->render_ms = (times[(runs - 1) / 2] + times[runs / 2]) / 2;
+   free(times);
+
+   return TRUE;
+}
+
+// Helper method used to order render times for qsort
+int compare_ms(const void *first, const void *second)
+{
+   // Variable declarations
+   double a = *(const double *)first;
+   double b = *(const double *)second;
+
+   return (a > b) - (a < b);
+}
+
+// Helper method used to compile a case's scene into the output directory,
+// replacing scene_name with the compiled file
+bool compile_case(const check_case *cur_case, char *raytrace, char *scene_name)
+{
+   // Variable declarations
+   char compiled_name[CHECK_PATH_LEN];
+   char *args[] = { raytrace, COMPILE_OPTION, scene_name, compiled_name, NULL };
+   int status;
+   pid_t child;
+
+   snprintf(compiled_name, sizeof(compiled_name), "%s/%s.bin", CHECK_OUT_DIR, cur_case->name);
+   child = fork();
+   if (child == 0)
+   {
+      execv(args[0], args);
+      _exit(RUN_FAIL);
+   }
+   if (child < 0 || waitpid(child, &status, 0) != child || WIFEXITED(status) == 0 || WEXITSTATUS(status) != RUN_SUCCESS)
+   {
+      return FALSE;
+   }
+
+   snprintf(scene_name, CHECK_PATH_LEN, "%s", compiled_name);
+   return TRUE;
+}
+
+// Helper method used to compare a render with its golden image, counting the
+// pixels with a channel more than tolerance levels off and the largest
+// difference. Images that cannot be read or differ in size never match, and
+// count -1 differing pixels.
+bool compare_images(char *output_name, const char *golden_name, int tolerance, int *differing, int *largest)
+{
+   // Variable declarations
+   int out_width;
+   int out_height;
+   int golden_width;
+   int golden_height;
+   unsigned char *output = read_ppm(output_name, &out_width, &out_height);
+   unsigned char *golden = read_ppm(golden_name, &golden_width, &golden_height);
+   bool same_size = output != NULL && golden != NULL && out_width == golden_width && out_height == golden_height;
+
+   // Compare every pixel, a channel at a time
+   *differing = 0;
+   *largest = 0;
+   for (size_t pixel = 0; same_size == TRUE && pixel < (size_t)out_width * out_height; pixel++)
+   {
+      // Variable declarations
+      bool off = FALSE;
+
+      for (int channel = 0; channel < 3; channel++)
+      {
+         // Variable declarations
+         int difference = abs(output[pixel * 3 + channel] - golden[pixel * 3 + channel]);
+
+         *largest = difference > *largest ? difference : *largest;
+         off = off == TRUE || difference > tolerance;
+      }
+      *differing += off == TRUE ? 1 : 0;
+   }
+
+   free(output);
+   free(golden);
+   *differing = same_size == TRUE ? *differing : -1;
+   return *differing == 0;
+}
+
+// Helper method used to read the pixels of a binary PPM written by the raycaster
+unsigned char *read_ppm(const char *file_name, int *width, int *height)
+{
+   // Variable declarations
+   FILE *in = fopen(file_name, "rb");
+   unsigned char *pixels = NULL;
+   int depth;
+
+   if (in == NULL)
+   {
+      return NULL;
+   }
+
+   // Read the header, then the one whitespace byte before the pixels
+   if (fscanf(in, "P6 %d %d %d", width, height, &depth) == 3 && *width > 0 && *height > 0 && depth == 255 && fgetc(in) != EOF)
+   {
+      pixels = malloc((size_t)*width * *height * 3);
+      if (fread(pixels, 3, (size_t)*width * *height, in) != (size_t)*width * *height)
+      {
+         free(pixels);
+         pixels = NULL;
+      }
+   }
+
+   fclose(in);
+   return pixels;
+}
+
+// Helper method used to read the stored baseline, one "name render_ms rays"
+// line per case; lines starting with # are comments. Returns the entry count.
+int load_baseline(baseline_entry *entries)
+{
+   // Variable declarations
+   FILE *in = fopen(CHECK_BASELINE, "r");
+   char line[CHECK_LINE_LEN];
+   int count = 0;
+
+   if (in == NULL)
+   {
+      return 0;
+   }
+
+   while (count < CHECK_MAX_CASES && fgets(line, sizeof(line), in) != NULL)
+   {
+      if (line[0] != '#' && sscanf(line, "%63s %lf %ld", entries[count].name, &(entries[count].render_ms), &(entries[count].rays)) == 3)
+      {
+         count++;
+      }
+   }
+
+   fclose(in);
+   return count;
+}
+
+// Helper method used to find the baseline of a case by name, or NULL if it has none
+baseline_entry *find_baseline(baseline_entry *entries, int count, const char *name)
+{
+   for (int index = 0; index < count; index++)
+   {
+      if (strcmp(entries[index].name, name) == 0)
+      {
+         return &entries[index];
+      }
+   }
+
+   return NULL;
+}
+
+// Helper method used to write the measured cases out as the new baseline
+bool save_baseline(baseline_entry *entries, int count)
+{
+   // Variable declarations
+   FILE *out = fopen(CHECK_BASELINE, "w");
+
+   if (out == NULL)
+   {
+      return FALSE;
+   }
+
+   fprintf(out, "# Median render time in ms and rays per frame of each check case, written by make check-baseline\n");
+   for (int index = 0; index < count; index++)
+   {
+      fprintf(out, "%s %.3f %ld\n", entries[index].name, entries[index].render_ms, entries[index].rays);
+   }
+
+   return fclose(out) == 0;
+}
@@ -0,0 +1,21 @@
+#ifndef CHECK
+#define CHECK
+
+#include "raycast.h"
+
+#define CHECK_RAYTRACE "./raytrace"
+#define CHECK_DIR "check"
+#define CHECK_OUT_DIR "check_output"
+#define CHECK_BASELINE "check/baseline.txt"
+#define CHECK_RUNS 7
+#define CHECK_SLOWDOWN_PCT 15.0
+#define CHECK_SLACK_MS 1.0
+#define CHECK_RAY_SLACK_PCT 0.0
+#define CHECK_PATH_LEN 256
+#define CHECK_NAME_LEN 64
+#define CHECK_LINE_LEN 256
+#define CHECK_MAX_ARGS 16
+#define CHECK_MAX_EXTRA 3
+#define CHECK_MAX_CASES 64
+
+#endif
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raycast.h"
+#include "isa.h"
+#include "framebuffer.h"
+
+// Vector types for KERNEL_WIDTH color channels
+typedef float v8sf __attribute__((vector_size(32)));
+typedef int v8si __attribute__((vector_size(32)));
+
+// Forward declarations
+void quantize_span_scalar(const float *values, unsigned char *bytes, size_t count);
+void quantize_span_sse2(const float *values, unsigned char *bytes, size_t count);
+void quantize_span_sse4(const float *values, unsigned char *bytes, size_t count);
+void quantize_span_avx2(const float *values, unsigned char *bytes, size_t count);
+void quantize_span_avx512(const float *values, unsigned char *bytes, size_t count);
+
+// Quantize kernels for each level, indexed by level
+static void (*quantize_spans[ISA_COUNT])(const float *values, unsigned char *bytes, size_t count) =
+{
+   quantize_span_scalar, quantize_span_scalar, quantize_span_sse2,
+   quantize_span_sse4, quantize_span_avx2, quantize_span_avx512
+};
+
+// Quantize kernel in use, scalar until select_quantize picks a level
+static int quantize_level = ISA_SCALAR;
+
+// Method used to allocate a framebuffer holding the packed rgb triples written
+// to the output file. Colors are accumulated in floats per tile by the render
+// threads, so only their final values reach it.
+void create_framebuffer(framebuffer *fb, int width, int height)
+{
+   fb->width = width;
+   fb->height = height;
+   fb->bytes = calloc((size_t)width * height, FB_CHANNELS);
+}
+
+// Helper method used to release a framebuffer
+void free_framebuffer(framebuffer *fb)
+{
+   free(fb->bytes);
+   fb->bytes = NULL;
+}
+
+// Method used to quantize the final color of a pixel into the buffer
+void store_pixel(framebuffer *fb, int x, int y, rgb *color)
+{
+   // Variable declarations
+   size_t index = (size_t)y * fb->width + x;
+
+   fb->bytes[index * FB_CHANNELS] = quantize(color->r);
+   fb->bytes[index * FB_CHANNELS + 1] = quantize(color->g);
+   fb->bytes[index * FB_CHANNELS + 2] = quantize(color->b);
+}
+
+// Method used to quantize the final colors of a run of pixels along one row
+void store_span(framebuffer *fb, int x, int y, rgb *colors, int count)
+{
+   // Variable declarations
+   size_t index = (size_t)y * fb->width + x;
+
+   // Quantize every channel of the run at once
+   quantize_span((float *)colors, fb->bytes + index * FB_CHANNELS, (size_t)count * FB_CHANNELS);
+}
+
+// Helper method used to clamp a color channel and scale it to a byte
+unsigned char quantize(float value)
+{
+   // Clamp to the displayable range first
+   value = clamp(value, 0, 1);
+
+   // Truncate the scaled value, matching the original output
+   return (unsigned char)(value * 255);
+}
+
+// Method used to switch to the quantize kernel built for a level
+void select_quantize(int level)
+{
+   quantize_level = level;
+}
+
+// Method used to quantize a run of color channels into bytes with the selected kernel
+void quantize_span(const float *values, unsigned char *bytes, size_t count)
+{
+   quantize_spans[quantize_level](values, bytes, count);
+}
+
+// Helper method used as the reference quantize kernel
+void quantize_span_scalar(const float *values, unsigned char *bytes, size_t count)
+{
+   for (size_t index = 0; index < count; index++)
+   {
+      bytes[index] = quantize(values[index]);
+   }
+}
+
+// Helper function used to quantize KERNEL_WIDTH channels at a time, following
+// quantize exactly. It is always inlined, so each level below gets its own build.
+static inline __attribute__((always_inline)) void quantize_vector(const float *values, unsigned char *bytes, size_t count)
+{
+   // Variable declarations
+   v8sf zero = { 0 };
+   v8sf value;
+   v8si mask;
+   v8si scaled;
+   size_t index = 0;
+
+   // Convert whole vectors first, clamping to [0, 1] before scaling and truncating
+   for (; index + KERNEL_WIDTH <= count; index += KERNEL_WIDTH)
+   {
+      memcpy(&value, values + index, sizeof(v8sf));
+      mask = value > 1;
+      value = (v8sf)((mask & (v8si)(zero + 1)) | (~mask & (v8si)value));
+      mask = value < 0;
+      value = (v8sf)(~mask & (v8si)value);
+      scaled = __builtin_convertvector(value * 255, v8si);
+      for (int lane = 0; lane < KERNEL_WIDTH; lane++)
+      {
+         bytes[index + lane] = (unsigned char)scaled[lane];
+      }
+   }
+
+   // Finish whatever is left one channel at a time
+   for (; index < count; index++)
+   {
+      bytes[index] = quantize(values[index]);
+   }
+}
+
+// Helper methods used as the quantize kernel for each level
+void quantize_span_sse2(const float *values, unsigned char *bytes, size_t count)
+{
+   quantize_vector(values, bytes, count);
+}
+
+__attribute__((target("sse4.2"))) void quantize_span_sse4(const float *values, unsigned char *bytes, size_t count)
+{
+   quantize_vector(values, bytes, count);
+}
+
+__attribute__((target("avx2"))) void quantize_span_avx2(const float *values, unsigned char *bytes, size_t count)
+{
+   quantize_vector(values, bytes, count);
+}
+
+__attribute__((target("avx512f,avx512vl"))) void quantize_span_avx512(const float *values, unsigned char *bytes, size_t count)
+{
+   quantize_vector(values, bytes, count);
+}
@@ -0,0 +1,18 @@
+#ifndef FRAMEBUFFER
+#define FRAMEBUFFER
+
+#include "raycast.h"
+
+#define FB_CHANNELS 3
+#define FB_SPAN 64
+
+// Public function declarations
+void create_framebuffer(framebuffer *fb, int width, int height);
+void free_framebuffer(framebuffer *fb);
+void store_pixel(framebuffer *fb, int x, int y, rgb *color);
+void store_span(framebuffer *fb, int x, int y, rgb *colors, int count);
+unsigned char quantize(float value);
+void select_quantize(int level);
+void quantize_span(const float *values, unsigned char *bytes, size_t count);
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "raycast.h"
+#include "timer.h"
+#include "harness.h"
+
+// Method used to run the raycaster once with args, which must ask for
+// --stats=text, sending its report to log_name. The report gets the
+// raycaster's own timings and ray count along with the run's wall time and
+// peak resident set size. Returns FALSE if it could not run or did not render.
+bool run_raytrace(char **args, char *log_name, run_report *report)
+{
+   // Variable declarations
+   struct rusage usage;
+   double start;
+   int status;
+   int log_fd;
+   pid_t child;
+
+   // Run the raycaster with its report going to the log
+   memset(report, 0, sizeof(run_report));
+   log_fd = open(log_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (log_fd < 0)
+   {
+      return FALSE;
+   }
+   start = ib_now();
+   child = fork();
+   if (child == 0)
+   {
+      dup2(log_fd, STDERR_FILENO);
+      execv(args[0], args);
+      _exit(RUN_FAIL);
+   }
+   close(log_fd);
+   if (child < 0 || wait4(child, &status, 0, &usage) != child || WIFEXITED(status) == 0 || WEXITSTATUS(status) != RUN_SUCCESS)
+   {
+      return FALSE;
+   }
+   report->total_ms = (ib_now() - start) * 1000.0;
+   report->peak_kb = usage.ru_maxrss;
+
+   // Read the raycaster's own timings back
+   return read_report(log_name, report);
+}
+
+// Method used to read the phase timings and ray count from a --stats=text report
+bool read_report(char *log_name, run_report *report)
+{
+   // Variable declarations
+   FILE *log = fopen(log_name, "r");
+   char line[HARNESS_LINE_LEN];
+   bool rendered = FALSE;
+   long primary;
+   long secondary;
+   long shadow;
+
+   if (log == NULL)
+   {
+      return FALSE;
+   }
+
+   // Pick out the lines the harnesses use; a raycaster that printed an error has no render line
+   while (fgets(line, sizeof(line), log) != NULL)
+   {
+      if (sscanf(line, "render: %lf ms", &(report->render_ms)) == 1)
+      {
+         rendered = TRUE;
+      }
+      else if (sscanf(line, "parse: %lf ms", &(report->parse_ms)) != 1 && sscanf(line, "load: %lf ms", &(report->parse_ms)) != 1 &&
+               sscanf(line, "write: %lf ms", &(report->write_ms)) != 1 &&
+               sscanf(line, "rays: %ld primary, %ld secondary, %ld shadow", &primary, &secondary, &shadow) == 3)
+      {
+         report->rays = primary + secondary + shadow;
+         report->counted = TRUE;
+      }
+   }
+
+   fclose(log);
+   return rendered;
+}
+
+// Method used to fold one run into the best of several, keeping the fastest of
+// every timing and the largest footprint. The work is the same every run.
+void keep_best(run_report *best, run_report *run)
+{
+   if (best->total_ms == 0 || run->total_ms < best->total_ms)
+   {
+      best->total_ms = run->total_ms;
+   }
+   if (best->render_ms == 0 || run->render_ms < best->render_ms)
+   {
+      best->render_ms = run->render_ms;
+   }
+   if (best->parse_ms == 0 || run->parse_ms < best->parse_ms)
+   {
+      best->parse_ms = run->parse_ms;
+   }
+   if (best->write_ms == 0 || run->write_ms < best->write_ms)
+   {
+      best->write_ms = run->write_ms;
+   }
+   if (run->peak_kb > best->peak_kb)
+   {
+      best->peak_kb = run->peak_kb;
+   }
+   best->rays = run->rays;
+   best->counted = run->counted;
+}
@@ -0,0 +1,13 @@
+#ifndef HARNESS
+#define HARNESS
+
+#include "raycast.h"
+
+#define HARNESS_LINE_LEN 256
+
+// Public function declarations
+bool run_raytrace(char **args, char *log_name, run_report *report);
+bool read_report(char *log_name, run_report *report);
+void keep_best(run_report *best, run_report *run);
+
+#endif
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "raycast.h"
+#include "framebuffer.h"
+#include "heatmap.h"
+
+// False color scale from the cheapest pixels to the dearest: black, blue,
+// cyan, green, yellow, red, then white
+static const rgb heat_scale[] =
+{
+   { 0, 0, 0 }, { 0, 0, 1 }, { 0, 1, 1 }, { 0, 1, 0 }, { 1, 1, 0 }, { 1, 0, 0 }, { 1, 1, 1 }
+};
+
+// Method used to color every pixel of fb by its cost in heat. Costs are spread
+// over the scale logarithmically up to the dearest pixel of the image, since a
+// few deep reflective pixels can cost orders of magnitude more than the rest.
+void heat_image(float *heat, framebuffer *fb)
+{
+   // Variable declarations
+   size_t count = (size_t)fb->width * fb->height;
+   int stops = sizeof(heat_scale) / sizeof(rgb);
+   float highest = 0;
+   double scale;
+
+   // Find the dearest pixel
+   for (size_t index = 0; index < count; index++)
+   {
+      if (heat[index] > highest)
+      {
+         highest = heat[index];
+      }
+   }
+   scale = highest > 0 ? (stops - 1) / log1p(highest) : 0;
+
+   // Blend between the two stops around each pixel's place on the scale
+   for (int y = 0; y < fb->height; y++)
+   {
+      for (int x = 0; x < fb->width; x++)
+      {
+         // Variable declarations
+         double place = log1p(heat[(size_t)y * fb->width + x]) * scale;
+         int stop = place < stops - 1 ? (int)place : stops - 2;
+         float blend = place - stop;
+         rgb color;
+
+         color.r = heat_scale[stop].r + (heat_scale[stop + 1].r - heat_scale[stop].r) * blend;
+         color.g = heat_scale[stop].g + (heat_scale[stop + 1].g - heat_scale[stop].g) * blend;
+         color.b = heat_scale[stop].b + (heat_scale[stop + 1].b - heat_scale[stop].b) * blend;
+         store_pixel(fb, x, y, &color);
+      }
+   }
+}
+
+// Method used to name the heatmap after the output image, replacing a .ppm
+// extension with .heat.ppm or adding .heat.ppm to any other name
+void heat_file_name(char *output_name, char *heat_name)
+{
+   // Variable declarations
+   size_t length = strlen(output_name);
+   size_t extension = strlen(HEAT_EXTENSION);
+
+   if (length >= extension && strcmp(output_name + length - extension, HEAT_EXTENSION) == 0)
+   {
+      length -= extension;
+   }
+   snprintf(heat_name, HEAT_NAME_LEN, "%.*s%s", (int)length, output_name, HEAT_SUFFIX);
+}
@@ -0,0 +1,14 @@
+#ifndef HEATMAP
+#define HEATMAP
+
+#include "raycast.h"
+
+#define HEAT_EXTENSION ".ppm"
+#define HEAT_SUFFIX ".heat.ppm"
+#define HEAT_NAME_LEN 4096
+
+// Public function declarations
+void heat_image(float *heat, framebuffer *fb);
+void heat_file_name(char *output_name, char *heat_name);
+
+#endif
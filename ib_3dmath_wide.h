@@ -0,0 +1,348 @@
+// Ensure program is only compiled once
+#ifndef IB_3D_WIDE
+#define IB_3D_WIDE
+
+#include <string.h>
+#include <float.h>
+#include "ib_3dmath.h"
+
+// Wide companion to ib_3dmath.h. Each ib_v3x4/ib_v3x8 holds four or eight
+// vectors in SoA form, one lane per vector, and every function does the same
+// work as its scalar counterpart on each lane. The scalar functions stay the
+// reference; only normalize differs, using an rsqrt estimate refined by one
+// Newton step, which lands within a few ulps of the scalar result. mathtest.c
+// checks every function against its scalar counterpart lane by lane.
+
+// Type declarations
+typedef float ib_f4 __attribute__((vector_size(16)));
+typedef float ib_f8 __attribute__((vector_size(32)));
+typedef struct ib_v3x4 ib_v3x4;
+typedef struct ib_v3x8 ib_v3x8;
+
+// Struct implementations
+struct ib_v3x4
+{
+   ib_f4 x, y, z;
+};
+
+struct ib_v3x8
+{
+   ib_f8 x, y, z;
+};
+
+// Function used to fill every lane with the same vector
+static inline void ib_v3x4_splat(ib_v3x4 *out, ib_v3 *in)
+{
+   // Variable declarations
+   ib_f4 zero = { 0 };
+
+   // Broadcast x, y, and z of input vector
+   out->x = zero + in->x;
+   out->y = zero + in->y;
+   out->z = zero + in->z;
+}
+
+static inline void ib_v3x8_splat(ib_v3x8 *out, ib_v3 *in)
+{
+   // Variable declarations
+   ib_f8 zero = { 0 };
+
+   // Broadcast x, y, and z of input vector
+   out->x = zero + in->x;
+   out->y = zero + in->y;
+   out->z = zero + in->z;
+}
+
+// Function used to store a vector into one lane
+static inline void ib_v3x4_set(ib_v3x4 *out, int lane, ib_v3 *in)
+{
+   out->x[lane] = in->x;
+   out->y[lane] = in->y;
+   out->z[lane] = in->z;
+}
+
+static inline void ib_v3x8_set(ib_v3x8 *out, int lane, ib_v3 *in)
+{
+   out->x[lane] = in->x;
+   out->y[lane] = in->y;
+   out->z[lane] = in->z;
+}
+
+// Function used to read the vector back out of one lane
+static inline void ib_v3x4_get(ib_v3 *out, ib_v3x4 *in, int lane)
+{
+   out->x = in->x[lane];
+   out->y = in->y[lane];
+   out->z = in->z[lane];
+}
+
+static inline void ib_v3x8_get(ib_v3 *out, ib_v3x8 *in, int lane)
+{
+   out->x = in->x[lane];
+   out->y = in->y[lane];
+   out->z = in->z[lane];
+}
+
+// Add function for 2 sets of vectors a and b
+static inline void ib_v3x4_add(ib_v3x4 *out, ib_v3x4 *a, ib_v3x4 *b)
+{
+   // Set x, y, and z of output vectors
+   out->x = a->x + b->x;
+   out->y = a->y + b->y;
+   out->z = a->z + b->z;
+}
+
+static inline void ib_v3x8_add(ib_v3x8 *out, ib_v3x8 *a, ib_v3x8 *b)
+{
+   // Set x, y, and z of output vectors
+   out->x = a->x + b->x;
+   out->y = a->y + b->y;
+   out->z = a->z + b->z;
+}
+
+// Subtract function for 2 sets of vectors a and b
+static inline void ib_v3x4_sub(ib_v3x4 *out, ib_v3x4 *a, ib_v3x4 *b)
+{
+   // Set x, y, and z of output vectors
+   out->x = a->x - b->x;
+   out->y = a->y - b->y;
+   out->z = a->z - b->z;
+}
+
+static inline void ib_v3x8_sub(ib_v3x8 *out, ib_v3x8 *a, ib_v3x8 *b)
+{
+   // Set x, y, and z of output vectors
+   out->x = a->x - b->x;
+   out->y = a->y - b->y;
+   out->z = a->z - b->z;
+}
+
+// Multiply function for 2 sets of vectors a and b
+static inline void ib_v3x4_mult(ib_v3x4 *out, ib_v3x4 *a, ib_v3x4 *b)
+{
+   // Set x, y, and z of output vectors
+   out->x = a->x * b->x;
+   out->y = a->y * b->y;
+   out->z = a->z * b->z;
+}
+
+static inline void ib_v3x8_mult(ib_v3x8 *out, ib_v3x8 *a, ib_v3x8 *b)
+{
+   // Set x, y, and z of output vectors
+   out->x = a->x * b->x;
+   out->y = a->y * b->y;
+   out->z = a->z * b->z;
+}
+
+// Function used to scale each input vector by the scale value in its lane
+static inline void ib_v3x4_scale(ib_v3x4 *out, ib_f4 *scale, ib_v3x4 *in)
+{
+   // Scale x, y, and z of output vectors by scale values
+   out->x = in->x * *scale;
+   out->y = in->y * *scale;
+   out->z = in->z * *scale;
+}
+
+static inline void ib_v3x8_scale(ib_v3x8 *out, ib_f8 *scale, ib_v3x8 *in)
+{
+   // Scale x, y, and z of output vectors by scale values
+   out->x = in->x * *scale;
+   out->y = in->y * *scale;
+   out->z = in->z * *scale;
+}
+
+// Function used to calculate dot products of two sets of vectors
+static inline void ib_v3x4_dot(ib_f4 *out, ib_v3x4 *a, ib_v3x4 *b)
+{
+   // Return dot products
+   *out = (a->x * b->x) + (a->y * b->y) + (a->z * b->z);
+}
+
+static inline void ib_v3x8_dot(ib_f8 *out, ib_v3x8 *a, ib_v3x8 *b)
+{
+   // Return dot products
+   *out = (a->x * b->x) + (a->y * b->y) + (a->z * b->z);
+}
+
+// Function used to calculate the cross products of two sets of vectors
+static inline void ib_v3x4_cross(ib_v3x4 *out, ib_v3x4 *a, ib_v3x4 *b)
+{
+   // Variable declarations, so out may alias a or b
+   ib_f4 x = (a->y*b->z) - (a->z*b->y);
+   ib_f4 y = (a->z*b->x) - (a->x*b->z);
+   ib_f4 z = (a->x*b->y) - (a->y*b->x);
+
+   // Return cross between vectors a and b
+   out->x = x;
+   out->y = y;
+   out->z = z;
+}
+
+static inline void ib_v3x8_cross(ib_v3x8 *out, ib_v3x8 *a, ib_v3x8 *b)
+{
+   // Variable declarations, so out may alias a or b
+   ib_f8 x = (a->y*b->z) - (a->z*b->y);
+   ib_f8 y = (a->z*b->x) - (a->x*b->z);
+   ib_f8 z = (a->x*b->y) - (a->y*b->x);
+
+   // Return cross between vectors a and b
+   out->x = x;
+   out->y = y;
+   out->z = z;
+}
+
+// Get the lengths of the vectors
+static inline void ib_v3x4_len(ib_f4 *out, ib_v3x4 *in)
+{
+   // Variable declarations
+   ib_f4 squared = (in->x * in->x) + (in->y * in->y) + (in->z * in->z);
+
+   // Calculate and return lengths
+   for (int lane = 0; lane < 4; lane++)
+   {
+      (*out)[lane] = sqrtf(squared[lane]);
+   }
+}
+
+static inline void ib_v3x8_len(ib_f8 *out, ib_v3x8 *in)
+{
+   // Variable declarations
+   ib_f8 squared = (in->x * in->x) + (in->y * in->y) + (in->z * in->z);
+
+   // Calculate and return lengths
+   for (int lane = 0; lane < 8; lane++)
+   {
+      (*out)[lane] = sqrtf(squared[lane]);
+   }
+}
+
+// Function used to estimate 1 / sqrt(in) on each lane to about 12 bits
+static inline void ib_f4_rsqrt_estimate(ib_f4 *out, ib_f4 *in)
+{
+#ifdef __SSE__
+   *out = __builtin_ia32_rsqrtps(*in);
+#else
+   for (int lane = 0; lane < 4; lane++)
+   {
+      (*out)[lane] = 1 / sqrtf((*in)[lane]);
+   }
+#endif
+}
+
+static inline void ib_f8_rsqrt_estimate(ib_f8 *out, ib_f8 *in)
+{
+#ifdef __AVX__
+   *out = __builtin_ia32_rsqrtps256(*in);
+#else
+   // Variable declarations
+   ib_f4 halves[2];
+
+   // Work through the vector four lanes at a time
+   memcpy(halves, in, sizeof(ib_f8));
+   ib_f4_rsqrt_estimate(&halves[0], &halves[0]);
+   ib_f4_rsqrt_estimate(&halves[1], &halves[1]);
+   memcpy(out, halves, sizeof(ib_f8));
+#endif
+}
+
+// Function used to calculate 1 / sqrt(in) on each lane, refining the estimate
+// with one Newton step
+static inline void ib_f4_rsqrt(ib_f4 *out, ib_f4 *in)
+{
+   // Variable declarations
+   ib_f4 guess;
+
+   ib_f4_rsqrt_estimate(&guess, in);
+   *out = guess * (1.5f - 0.5f * *in * guess * guess);
+}
+
+static inline void ib_f8_rsqrt(ib_f8 *out, ib_f8 *in)
+{
+   // Variable declarations
+   ib_f8 guess;
+
+   ib_f8_rsqrt_estimate(&guess, in);
+   *out = guess * (1.5f - 0.5f * *in * guess * guess);
+}
+
+// Function used to scale a vector by a power of two, which keeps its direction
+// exactly, so that its largest component lies in [0.5, 1). Zero and non-finite
+// vectors are left as they are.
+static inline void ib_v3_rescale(ib_v3 *v)
+{
+   // Variable declarations
+   float largest = fmaxf(fabsf(v->x), fmaxf(fabsf(v->y), fabsf(v->z)));
+   int exponent;
+
+   if (largest == 0 || isfinite(largest) == 0)
+   {
+      return;
+   }
+
+   // Scale every dimension by the same power of two
+   frexpf(largest, &exponent);
+   v->x = ldexpf(v->x, -exponent);
+   v->y = ldexpf(v->y, -exponent);
+   v->z = ldexpf(v->z, -exponent);
+}
+
+// Function used to normalize a given set of vectors. Lanes whose squared
+// length underflows or overflows are rescaled first, so tiny and huge vectors
+// normalize like any other.
+static inline void ib_v3x4_normalize(ib_v3x4 *v)
+{
+   // Variable declarations
+   ib_f4 squared = (v->x * v->x) + (v->y * v->y) + (v->z * v->z);
+   ib_f4 inverse;
+
+   // Bring lanes out of range back into it, one at a time since they are rare
+   for (int lane = 0; lane < 4; lane++)
+   {
+      if (squared[lane] < FLT_MIN || squared[lane] > FLT_MAX)
+      {
+         // Variable declarations
+         ib_v3 cur;
+
+         ib_v3x4_get(&cur, v, lane);
+         ib_v3_rescale(&cur);
+         ib_v3x4_set(v, lane, &cur);
+         squared[lane] = (cur.x * cur.x) + (cur.y * cur.y) + (cur.z * cur.z);
+      }
+   }
+
+   // Calculate inverse length of each vector and multiply each dimension by it
+   ib_f4_rsqrt(&inverse, &squared);
+   v->x = v->x * inverse;
+   v->y = v->y * inverse;
+   v->z = v->z * inverse;
+}
+
+static inline void ib_v3x8_normalize(ib_v3x8 *v)
+{
+   // Variable declarations
+   ib_f8 squared = (v->x * v->x) + (v->y * v->y) + (v->z * v->z);
+   ib_f8 inverse;
+
+   // Bring lanes out of range back into it, one at a time since they are rare
+   for (int lane = 0; lane < 8; lane++)
+   {
+      if (squared[lane] < FLT_MIN || squared[lane] > FLT_MAX)
+      {
+         // Variable declarations
+         ib_v3 cur;
+
+         ib_v3x8_get(&cur, v, lane);
+         ib_v3_rescale(&cur);
+         ib_v3x8_set(v, lane, &cur);
+         squared[lane] = (cur.x * cur.x) + (cur.y * cur.y) + (cur.z * cur.z);
+      }
+   }
+
+   // Calculate inverse length of each vector and multiply each dimension by it
+   ib_f8_rsqrt(&inverse, &squared);
+   v->x = v->x * inverse;
+   v->y = v->y * inverse;
+   v->z = v->z * inverse;
+}
+
+#endif
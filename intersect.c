@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ib_3dmath.h"
+#include "raycast.h"
+#include "isa.h"
+#include "intersect.h"
+#include "stats.h"
+
+// Vector types for one ray against KERNEL_WIDTH primitives
+typedef float v4sf __attribute__((vector_size(16)));
+typedef float v8sf __attribute__((vector_size(32)));
+typedef int v8si __attribute__((vector_size(32)));
+
+// Forward declarations
+void spheres_closest_scalar(sphere_set *spheres, int first, int count, ib_v3 *r0, ib_v3 *rd, float *t, int *hit);
+int spheres_occluder_scalar(sphere_set *spheres, int first, int count, ib_v3 *r0, ib_v3 *rd, float dist, int skip);
+void planes_closest_scalar(plane_set *planes, int id_base, ib_v3 *r0, ib_v3 *rd, float *t, int *hit);
+int planes_occluder_scalar(plane_set *planes, int id_base, ib_v3 *r0, ib_v3 *rd, float dist, int skip);
+void spheres_closest_frame_scalar(frame_terms *frame, sphere_set *spheres, int first, int count, ib_v3 *rd, float *t, int *hit);
+void planes_closest_frame_scalar(frame_terms *frame, plane_set *planes, int id_base, ib_v3 *rd, float *t, int *hit);
+
+// Kernels built for the baseline, SSE2 on every x86-64 CPU
+#define KERNEL_NAME(name) name##_sse2
+#include "intersect_kernel.h"
+#undef KERNEL_NAME
+
+// Kernels built for SSE4.2
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+#define KERNEL_NAME(name) name##_sse4
+#include "intersect_kernel.h"
+#undef KERNEL_NAME
+#pragma GCC pop_options
+
+// Kernels built for AVX2
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define KERNEL_NAME(name) name##_avx2
+#include "intersect_kernel.h"
+#undef KERNEL_NAME
+#pragma GCC pop_options
+
+// Kernels built for AVX-512, using its mask registers on 8-lane vectors
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512vl")
+#define KERNEL_NAME(name) name##_avx512
+#include "intersect_kernel.h"
+#undef KERNEL_NAME
+#pragma GCC pop_options
+
+// Kernels for each level, indexed by level
+static kernel_set kernel_sets[ISA_COUNT] =
+{
+   { spheres_closest_scalar, spheres_occluder_scalar, planes_closest_scalar, planes_occluder_scalar,
+     spheres_closest_frame_scalar, planes_closest_frame_scalar },
+   { spheres_closest_scalar, spheres_occluder_scalar, planes_closest_scalar, planes_occluder_scalar,
+     spheres_closest_frame_scalar, planes_closest_frame_scalar },
+   { spheres_closest_sse2, spheres_occluder_sse2, planes_closest_sse2, planes_occluder_sse2,
+     spheres_closest_frame_sse2, planes_closest_frame_sse2 },
+   { spheres_closest_sse4, spheres_occluder_sse4, planes_closest_sse4, planes_occluder_sse4,
+     spheres_closest_frame_sse4, planes_closest_frame_sse4 },
+   { spheres_closest_avx2, spheres_occluder_avx2, planes_closest_avx2, planes_occluder_avx2,
+     spheres_closest_frame_avx2, planes_closest_frame_avx2 },
+   { spheres_closest_avx512, spheres_occluder_avx512, planes_closest_avx512, planes_occluder_avx512,
+     spheres_closest_frame_avx512, planes_closest_frame_avx512 }
+};
+
+// Kernels in use, scalar until select_intersect picks a level
+static kernel_set *kernels = &kernel_sets[ISA_SCALAR];
+
+// Method used to switch to the intersection kernels built for a level
+void select_intersect(int level)
+{
+   kernels = &kernel_sets[level];
+}
+
+// Method used to find the closest of a range of spheres, keeping the current
+// hit unless a sphere is closer or equally close with a lower id
+void spheres_closest(sphere_set *spheres, int first, int count, ib_v3 *r0, ib_v3 *rd, float *t, int *hit)
+{
+   STAT_ADD(sphere_tests, count);
+   kernels->spheres_closest(spheres, first, count, r0, rd, t, hit);
+}
+
+// Method used to find a sphere in a range other than skip that is hit before
+// dist, returning its id or -1 if there is none
+int spheres_occluder(sphere_set *spheres, int first, int count, ib_v3 *r0, ib_v3 *rd, float dist, int skip)
+{
+   STAT_ADD(sphere_tests, count);
+   return kernels->spheres_occluder(spheres, first, count, r0, rd, dist, skip);
+}
+
+// Method used to find the closest plane in front of the origin, replacing the
+// current hit only if the plane is strictly closer. Plane ids start at id_base.
+void planes_closest(plane_set *planes, int id_base, ib_v3 *r0, ib_v3 *rd, float *t, int *hit)
+{
+   STAT_ADD(plane_tests, planes->count);
+   kernels->planes_closest(planes, id_base, r0, rd, t, hit);
+}
+
+// Method used to find a plane other than skip that is hit before dist,
+// returning its id or -1 if there is none
+int planes_occluder(plane_set *planes, int id_base, ib_v3 *r0, ib_v3 *rd, float dist, int skip)
+{
+   STAT_ADD(plane_tests, planes->count);
+   return kernels->planes_occluder(planes, id_base, r0, rd, dist, skip);
+}
+
+// Method used to find the closest of a range of spheres for a ray from the frame origin
+void spheres_closest_frame(frame_terms *frame, sphere_set *spheres, int first, int count, ib_v3 *rd, float *t, int *hit)
+{
+   STAT_ADD(sphere_tests, count);
+   kernels->spheres_closest_frame(frame, spheres, first, count, rd, t, hit);
+}
+
+// Method used to find the closest plane for a ray from the frame origin
+void planes_closest_frame(frame_terms *frame, plane_set *planes, int id_base, ib_v3 *rd, float *t, int *hit)
+{
+   STAT_ADD(plane_tests, planes->count);
+   kernels->planes_closest_frame(frame, planes, id_base, rd, t, hit);
+}
+
+// Helper method used as the reference sphere kernel
+void spheres_closest_scalar(sphere_set *spheres, int first, int count, ib_v3 *r0, ib_v3 *rd, float *t, int *hit)
+{
+   // Variable declarations
+   float cur_t;
+
+   for (int index = first; index < first + count; index++)
+   {
+      cur_t = INFINITY;
+      sphere_intersection(r0, rd, spheres, index, &cur_t);
+
+      // Keep the lowest primitive id on ties so results do not depend on traversal order
+      if (cur_t < *t || (cur_t == *t && index < *hit))
+      {
+         *t = cur_t;
+         *hit = index;
+      }
+   }
+}
+
+// Helper method used as the reference sphere occlusion kernel
+int spheres_occluder_scalar(sphere_set *spheres, int first, int count, ib_v3 *r0, ib_v3 *rd, float dist, int skip)
+{
+   // Variable declarations
+   float cur_t;
+
+   for (int index = first; index < first + count; index++)
+   {
+      if (index == skip)
+      {
+         continue;
+      }
+
+      cur_t = INFINITY;
+      sphere_intersection(r0, rd, spheres, index, &cur_t);
+      if (cur_t < dist && cur_t > 0.0)
+      {
+         return index;
+      }
+   }
+
+   return -1;
+}
+
+// Helper method used as the reference plane kernel
+void planes_closest_scalar(plane_set *planes, int id_base, ib_v3 *r0, ib_v3 *rd, float *t, int *hit)
+{
+   // Variable declarations
+   float cur_t;
+
+   for (int index = 0; index < planes->count; index++)
+   {
+      plane_intersection(r0, rd, planes, index, &cur_t);
+
+      if (cur_t < *t && cur_t > 0)
+      {
+         *t = cur_t;
+         *hit = id_base + index;
+      }
+   }
+}
+
+// Helper method used as the reference plane occlusion kernel
+int planes_occluder_scalar(plane_set *planes, int id_base, ib_v3 *r0, ib_v3 *rd, float dist, int skip)
+{
+   // Variable declarations
+   float cur_t;
+
+   for (int index = 0; index < planes->count; index++)
+   {
+      if (id_base + index == skip)
+      {
+         continue;
+      }
+
+      plane_intersection(r0, rd, planes, index, &cur_t);
+      if (cur_t < dist && cur_t > 0.0)
+      {
+         return id_base + index;
+      }
+   }
+
+   return -1;
+}
+
+// Helper method used as the reference sphere kernel for rays from the frame origin
+void spheres_closest_frame_scalar(frame_terms *frame, sphere_set *spheres, int first, int count, ib_v3 *rd, float *t, int *hit)
+{
+   // Variable declarations
+   float cur_t;
+
+   for (int index = first; index < first + count; index++)
+   {
+      // Variable declarations
+      ib_v3 offset = { frame->ox[index], frame->oy[index], frame->oz[index] };
+
+      cur_t = INFINITY;
+      sphere_offset_intersection(&offset, rd, spheres->radius2[index], &cur_t);
+      if (cur_t < *t || (cur_t == *t && index < *hit))
+      {
+         *t = cur_t;
+         *hit = index;
+      }
+   }
+}
+
+// Helper method used as the reference plane kernel for rays from the frame origin
+void planes_closest_frame_scalar(frame_terms *frame, plane_set *planes, int id_base, ib_v3 *rd, float *t, int *hit)
+{
+   // Variable declarations
+   float cur_t;
+
+   for (int index = 0; index < planes->count; index++)
+   {
+      plane_offset_intersection(frame->plane_offset[index], rd, planes, index, &cur_t);
+      if (cur_t < *t && cur_t > 0)
+      {
+         *t = cur_t;
+         *hit = id_base + index;
+      }
+   }
+}
+
+// Method used to check whether one primitive, given by id, is hit before dist
+bool primitive_occludes(scene *scn, int id, ib_v3 *r0, ib_v3 *rd, float dist)
+{
+   // Variable declarations
+   float cur_t = INFINITY;
+
+   // Ids number the spheres first, then the planes
+   if (id < scn->spheres.count)
+   {
+      STAT_ADD(sphere_tests, 1);
+      sphere_intersection(r0, rd, &(scn->spheres), id, &cur_t);
+   }
+   else
+   {
+      STAT_ADD(plane_tests, 1);
+      plane_intersection(r0, rd, &(scn->planes), id - scn->spheres.count, &cur_t);
+   }
+
+   return cur_t < dist && cur_t > 0.0;
+}
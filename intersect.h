@@ -0,0 +1,16 @@
+#ifndef INTERSECT
+#define INTERSECT
+
+#include "raycast.h"
+
+// Public function declarations
+void select_intersect(int level);
+void spheres_closest(sphere_set *spheres, int first, int count, ib_v3 *r0, ib_v3 *rd, float *t, int *hit);
+int spheres_occluder(sphere_set *spheres, int first, int count, ib_v3 *r0, ib_v3 *rd, float dist, int skip);
+void planes_closest(plane_set *planes, int id_base, ib_v3 *r0, ib_v3 *rd, float *t, int *hit);
+int planes_occluder(plane_set *planes, int id_base, ib_v3 *r0, ib_v3 *rd, float dist, int skip);
+void spheres_closest_frame(frame_terms *frame, sphere_set *spheres, int first, int count, ib_v3 *rd, float *t, int *hit);
+void planes_closest_frame(frame_terms *frame, plane_set *planes, int id_base, ib_v3 *rd, float *t, int *hit);
+bool primitive_occludes(scene *scn, int id, ib_v3 *r0, ib_v3 *rd, float dist);
+
+#endif
@@ -0,0 +1,283 @@
+// Intersection kernels for one instruction set. intersect.c includes this file
+// once per level with KERNEL_NAME defined, under a matching target pragma, so it
+// deliberately has no include guard. Every kernel tests one ray against
+// KERNEL_WIDTH primitives at a time; narrower targets split the vectors.
+
+// Helper function used to load KERNEL_WIDTH floats; the arrays are padded so this never reads past them
+static inline __attribute__((always_inline)) v8sf KERNEL_NAME(load)(const float *values)
+{
+   // Variable declarations
+   v8sf out;
+
+   memcpy(&out, values, sizeof(v8sf));
+   return out;
+}
+
+// Helper function used to pick a where mask is set and b everywhere else
+static inline __attribute__((always_inline)) v8sf KERNEL_NAME(select)(v8si mask, v8sf a, v8sf b)
+{
+   return (v8sf)((mask & (v8si)a) | (~mask & (v8si)b));
+}
+
+// Helper function used to check whether any lane of a mask is set
+static inline __attribute__((always_inline)) bool KERNEL_NAME(any)(v8si mask)
+{
+   // Variable declarations
+   int found = 0;
+
+   for (int lane = 0; lane < KERNEL_WIDTH; lane++)
+   {
+      found |= mask[lane];
+   }
+
+   return found != 0;
+}
+
+// Helper function used to find the lowest lane of a mask that is set, or -1 if none are
+static inline __attribute__((always_inline)) int KERNEL_NAME(first)(v8si mask)
+{
+   for (int lane = 0; lane < KERNEL_WIDTH; lane++)
+   {
+      if (mask[lane] != 0)
+      {
+         return lane;
+      }
+   }
+
+   return -1;
+}
+
+// Helper function used to take the square root of every lane
+static inline __attribute__((always_inline)) v8sf KERNEL_NAME(sqrt)(v8sf value)
+{
+#ifdef __AVX__
+   return __builtin_ia32_sqrtps256(value);
+#else
+   // Variable declarations
+   v4sf halves[2];
+
+   // Work through the vector four lanes at a time
+   memcpy(halves, &value, sizeof(v8sf));
+   halves[0] = __builtin_ia32_sqrtps(halves[0]);
+   halves[1] = __builtin_ia32_sqrtps(halves[1]);
+   memcpy(&value, halves, sizeof(v8sf));
+   return value;
+#endif
+}
+
+// Helper function used to find the lowest lane holding the smallest value, or -1 if every lane is INFINITY
+static inline __attribute__((always_inline)) int KERNEL_NAME(lowest)(v8sf values, float *smallest)
+{
+   // Variable declarations
+   int best = -1;
+
+   *smallest = INFINITY;
+   for (int lane = 0; lane < KERNEL_WIDTH; lane++)
+   {
+      if (values[lane] < *smallest)
+      {
+         *smallest = values[lane];
+         best = lane;
+      }
+   }
+
+   return best;
+}
+
+// Helper function used to solve one ray against KERNEL_WIDTH spheres given the
+// offsets from their centers to the ray origin, following sphere_offset_intersection
+// exactly. Lanes that miss, or are not in use, get INFINITY.
+static inline __attribute__((always_inline)) v8sf KERNEL_NAME(solve_spheres)(v8sf ox, v8sf oy, v8sf oz, v8sf radius2, v8si used, ib_v3 *rd)
+{
+   // Variable declarations
+   float a = (rd->x * rd->x) + (rd->y * rd->y) + (rd->z * rd->z);
+   v8sf b = rd->x * ox + rd->y * oy + rd->z * oz;
+   v8sf c = (ox * ox + oy * oy + oz * oz) - radius2;
+   v8sf d = b * b - a * c;
+   v8si hit = used & (d > 0);
+   v8sf t = (v8sf){ 0 } + INFINITY;
+   v8sf root;
+   v8sf t0;
+   v8sf t1;
+
+   // Only work out the roots if some sphere can be hit
+   if (KERNEL_NAME(any)(hit) == FALSE)
+   {
+      return t;
+   }
+
+   // Calculate both t values, preferring the nearer one in front of the origin
+   root = KERNEL_NAME(sqrt)(d);
+   t0 = (-b + root) / a;
+   t1 = (-b - root) / a;
+   t = KERNEL_NAME(select)(hit & (t0 > 0), t0, t);
+   return KERNEL_NAME(select)(hit & (t1 > 0), t1, t);
+}
+
+// Helper function used to intersect one ray with the KERNEL_WIDTH spheres from
+// first, following sphere_intersection exactly. Lanes at or past end, or for the
+// skip sphere, are not in use; they and the lanes that miss get INFINITY.
+static inline __attribute__((always_inline)) v8sf KERNEL_NAME(spheres)(sphere_set *spheres, int first, int end, int skip, ib_v3 *r0, ib_v3 *rd)
+{
+   // Variable declarations
+   v8si lane = (v8si){ 0, 1, 2, 3, 4, 5, 6, 7 } + first;
+
+   return KERNEL_NAME(solve_spheres)(r0->x - KERNEL_NAME(load)(spheres->x + first), r0->y - KERNEL_NAME(load)(spheres->y + first),
+                                     r0->z - KERNEL_NAME(load)(spheres->z + first), KERNEL_NAME(load)(spheres->radius2 + first),
+                                     (lane < end) & (lane != skip), rd);
+}
+
+// Helper function used to solve one ray against KERNEL_WIDTH planes given n . r0 + d
+// for each, following plane_offset_intersection exactly. Lanes not in use get -1.
+static inline __attribute__((always_inline)) v8sf KERNEL_NAME(solve_planes)(plane_set *planes, int first, v8sf offset, v8si used, ib_v3 *rd)
+{
+   // Variable declarations
+   v8sf den = KERNEL_NAME(load)(planes->nx + first) * rd->x + KERNEL_NAME(load)(planes->ny + first) * rd->y +
+              KERNEL_NAME(load)(planes->nz + first) * rd->z;
+
+   return KERNEL_NAME(select)(used & (den != 0), -offset / den, (v8sf){ 0 } - 1);
+}
+
+// Helper function used to intersect one ray with the KERNEL_WIDTH planes from
+// first, following plane_intersection exactly. Lanes past the last plane, or
+// for the skip plane, are not in use and get -1.
+static inline __attribute__((always_inline)) v8sf KERNEL_NAME(planes)(plane_set *planes, int first, int skip, ib_v3 *r0, ib_v3 *rd)
+{
+   // Variable declarations
+   v8si lane = (v8si){ 0, 1, 2, 3, 4, 5, 6, 7 } + first;
+   v8sf offset = KERNEL_NAME(load)(planes->nx + first) * r0->x + KERNEL_NAME(load)(planes->ny + first) * r0->y +
+                 KERNEL_NAME(load)(planes->nz + first) * r0->z + KERNEL_NAME(load)(planes->d + first);
+
+   return KERNEL_NAME(solve_planes)(planes, first, offset, (lane < planes->count) & (lane != skip), rd);
+}
+
+// Helper function used to keep the closest sphere of a block, or the lowest id
+// on ties, exactly as the scalar loop would pick
+static inline __attribute__((always_inline)) void KERNEL_NAME(keep_sphere)(v8sf cur_t, int block, float *t, int *hit)
+{
+   // Variable declarations
+   float smallest;
+   int lane;
+
+   if (KERNEL_NAME(any)(cur_t <= *t) == FALSE)
+   {
+      return;
+   }
+
+   lane = KERNEL_NAME(lowest)(cur_t, &smallest);
+   if (lane >= 0 && (smallest < *t || (smallest == *t && block + lane < *hit)))
+   {
+      *t = smallest;
+      *hit = block + lane;
+   }
+}
+
+// Helper function used to keep the closest plane of a block in front of the
+// origin. A tie keeps the earlier hit.
+static inline __attribute__((always_inline)) void KERNEL_NAME(keep_plane)(v8sf cur_t, int id, float *t, int *hit)
+{
+   // Variable declarations
+   float smallest;
+   int lane;
+
+   if (KERNEL_NAME(any)((cur_t > 0) & (cur_t < *t)) == FALSE)
+   {
+      return;
+   }
+
+   cur_t = KERNEL_NAME(select)(cur_t > 0, cur_t, (v8sf){ 0 } + INFINITY);
+   lane = KERNEL_NAME(lowest)(cur_t, &smallest);
+   if (lane >= 0 && smallest < *t)
+   {
+      *t = smallest;
+      *hit = id + lane;
+   }
+}
+
+// Helper method used as the sphere kernel for this level
+void KERNEL_NAME(spheres_closest)(sphere_set *spheres, int first, int count, ib_v3 *r0, ib_v3 *rd, float *t, int *hit)
+{
+   for (int block = first; block < first + count; block += KERNEL_WIDTH)
+   {
+      KERNEL_NAME(keep_sphere)(KERNEL_NAME(spheres)(spheres, block, first + count, -1, r0, rd), block, t, hit);
+   }
+}
+
+// Helper method used as the sphere kernel for this level for rays from the frame origin
+void KERNEL_NAME(spheres_closest_frame)(frame_terms *frame, sphere_set *spheres, int first, int count, ib_v3 *rd, float *t, int *hit)
+{
+   // Variable declarations
+   v8si lane = { 0, 1, 2, 3, 4, 5, 6, 7 };
+   v8sf cur_t;
+
+   for (int block = first; block < first + count; block += KERNEL_WIDTH)
+   {
+      cur_t = KERNEL_NAME(solve_spheres)(KERNEL_NAME(load)(frame->ox + block), KERNEL_NAME(load)(frame->oy + block),
+                                         KERNEL_NAME(load)(frame->oz + block), KERNEL_NAME(load)(spheres->radius2 + block),
+                                         (lane + block) < first + count, rd);
+      KERNEL_NAME(keep_sphere)(cur_t, block, t, hit);
+   }
+}
+
+// Helper method used as the sphere occlusion kernel for this level
+int KERNEL_NAME(spheres_occluder)(sphere_set *spheres, int first, int count, ib_v3 *r0, ib_v3 *rd, float dist, int skip)
+{
+   // Variable declarations
+   v8sf cur_t;
+   v8si blocked;
+
+   for (int block = first; block < first + count; block += KERNEL_WIDTH)
+   {
+      cur_t = KERNEL_NAME(spheres)(spheres, block, first + count, skip, r0, rd);
+      blocked = (cur_t < dist) & (cur_t > 0);
+      if (KERNEL_NAME(any)(blocked) == TRUE)
+      {
+         return block + KERNEL_NAME(first)(blocked);
+      }
+   }
+
+   return -1;
+}
+
+// Helper method used as the plane kernel for this level
+void KERNEL_NAME(planes_closest)(plane_set *planes, int id_base, ib_v3 *r0, ib_v3 *rd, float *t, int *hit)
+{
+   for (int block = 0; block < planes->count; block += KERNEL_WIDTH)
+   {
+      KERNEL_NAME(keep_plane)(KERNEL_NAME(planes)(planes, block, -1, r0, rd), id_base + block, t, hit);
+   }
+}
+
+// Helper method used as the plane kernel for this level for rays from the frame origin
+void KERNEL_NAME(planes_closest_frame)(frame_terms *frame, plane_set *planes, int id_base, ib_v3 *rd, float *t, int *hit)
+{
+   // Variable declarations
+   v8si lane = { 0, 1, 2, 3, 4, 5, 6, 7 };
+   v8sf cur_t;
+
+   for (int block = 0; block < planes->count; block += KERNEL_WIDTH)
+   {
+      cur_t = KERNEL_NAME(solve_planes)(planes, block, KERNEL_NAME(load)(frame->plane_offset + block), (lane + block) < planes->count, rd);
+      KERNEL_NAME(keep_plane)(cur_t, id_base + block, t, hit);
+   }
+}
+
+// Helper method used as the plane occlusion kernel for this level
+int KERNEL_NAME(planes_occluder)(plane_set *planes, int id_base, ib_v3 *r0, ib_v3 *rd, float dist, int skip)
+{
+   // Variable declarations
+   v8sf cur_t;
+   v8si blocked;
+
+   for (int block = 0; block < planes->count; block += KERNEL_WIDTH)
+   {
+      cur_t = KERNEL_NAME(planes)(planes, block, skip - id_base, r0, rd);
+      blocked = (cur_t < dist) & (cur_t > 0);
+      if (KERNEL_NAME(any)(blocked) == TRUE)
+      {
+         return id_base + block + KERNEL_NAME(first)(blocked);
+      }
+   }
+
+   return -1;
+}
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raycast.h"
+#include "isa.h"
+#include "intersect.h"
+#include "framebuffer.h"
+
+// Names accepted by --isa, indexed by level
+static const char *isa_names[ISA_COUNT] = { "auto", "scalar", "sse2", "sse4", "avx2", "avx512" };
+
+// Method used to find the highest instruction set level this CPU can run
+int detect_isa()
+{
+   // Variable declarations
+   int level = ISA_AVX512;
+
+   // Walk down from the widest level until one is supported
+   while (level > ISA_SSE2 && isa_supported(level) == FALSE)
+   {
+      level--;
+   }
+
+   return level;
+}
+
+// Method used to check whether this CPU can run kernels built for a level.
+// SSE2 is part of every x86-64 CPU, so only the newer levels need checking.
+bool isa_supported(int level)
+{
+   // Variable declarations
+   bool supported = level == ISA_SCALAR || level == ISA_SSE2;
+
+   __builtin_cpu_init();
+   if (level == ISA_SSE4)
+   {
+      supported = __builtin_cpu_supports("sse4.2");
+   }
+   else if (level == ISA_AVX2)
+   {
+      supported = __builtin_cpu_supports("avx2");
+   }
+   else if (level == ISA_AVX512)
+   {
+      supported = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl");
+   }
+
+   return supported != 0;
+}
+
+// Method used to turn an --isa value into its level, or -1 if it is not one
+int isa_level(char *name)
+{
+   for (int level = 0; level < ISA_COUNT; level++)
+   {
+      if (strcmp(name, isa_names[level]) == 0)
+      {
+         return level;
+      }
+   }
+
+   return -1;
+}
+
+// Method used to get the name of a level for messages
+const char *isa_name(int level)
+{
+   return isa_names[level];
+}
+
+// Method used to point every dispatched kernel at the build for one level.
+// The caller makes sure the CPU supports it.
+void select_kernels(int level)
+{
+   select_intersect(level);
+   select_quantize(level);
+}
@@ -0,0 +1,21 @@
+#ifndef ISA
+#define ISA
+
+#include "raycast.h"
+
+#define ISA_AUTO 0
+#define ISA_SCALAR 1
+#define ISA_SSE2 2
+#define ISA_SSE4 3
+#define ISA_AVX2 4
+#define ISA_AVX512 5
+#define ISA_COUNT 6
+
+// Public function declarations
+int detect_isa();
+bool isa_supported(int level);
+int isa_level(char *name);
+const char *isa_name(int level);
+void select_kernels(int level);
+
+#endif
@@ -0,0 +1,439 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <float.h>
+#include <math.h>
+#include "ib_3dmath.h"
+#include "ib_3dmath_wide.h"
+#include "raycast.h"
+#include "mathtest.h"
+
+// Type definitions
+typedef struct math_inputs math_inputs;
+typedef struct math_case math_case;
+typedef struct math_result math_result;
+
+// Eight pairs of vectors and eight scale values, in scalar form and loaded
+// into the lanes of the wide types. The four lane types take the first four.
+struct math_inputs
+{
+   ib_v3 a[8];
+   ib_v3 b[8];
+   float scale[8];
+   ib_v3x4 a4;
+   ib_v3x4 b4;
+   ib_f4 scale4;
+   ib_v3x8 a8;
+   ib_v3x8 b8;
+   ib_f8 scale8;
+};
+
+// Lanes checked for one operation, how many of them were off by more than it
+// allows, and the furthest any lane was from the scalar result
+struct math_result
+{
+   long lanes;
+   long failures;
+   int worst;
+};
+
+// One checked operation: runs the four and eight lane versions on a set of
+// inputs and compares every lane with the scalar function, allowing ulps
+struct math_case
+{
+   const char *name;
+   void (*check)(math_inputs *in, int allowed, math_result *result);
+   int allowed;
+};
+
+// Forward declarations
+float math_random(float low, float high);
+void random_vector(ib_v3 *out);
+void draw_inputs(math_inputs *in, int round);
+int float_ulps(float expected, float got);
+void compare_vectors(ib_v3 *expected, ib_v3x4 *out4, ib_v3x8 *out8, int allowed, math_result *result);
+void compare_values(float *expected, ib_f4 *out4, ib_f8 *out8, int allowed, math_result *result);
+void reference_normalize(ib_v3 *v);
+void check_add(math_inputs *in, int allowed, math_result *result);
+void check_sub(math_inputs *in, int allowed, math_result *result);
+void check_mult(math_inputs *in, int allowed, math_result *result);
+void check_scale(math_inputs *in, int allowed, math_result *result);
+void check_dot(math_inputs *in, int allowed, math_result *result);
+void check_cross(math_inputs *in, int allowed, math_result *result);
+void check_len(math_inputs *in, int allowed, math_result *result);
+void check_normalize(math_inputs *in, int allowed, math_result *result);
+
+// Every case, with the ulps a lane may be off by. Only normalize works
+// differently from its scalar counterpart, so the rest must match bit for bit.
+static const math_case cases[] =
+{
+   { "add", check_add, 0 },
+   { "sub", check_sub, 0 },
+   { "mult", check_mult, 0 },
+   { "scale", check_scale, 0 },
+   { "dot", check_dot, 0 },
+   { "cross", check_cross, 0 },
+   { "len", check_len, 0 },
+   { "normalize", check_normalize, MATH_NORMALIZE_ULPS }
+};
+
+// Vectors at the edges of the float range, checked before the random ones
+static const ib_v3 edges[8] =
+{
+   { FLT_MAX, FLT_MAX, -FLT_MAX },
+   { FLT_TRUE_MIN, 0, 0 },
+   { FLT_MIN, -FLT_MIN, FLT_MIN },
+   { 1e-20, -1e-20, 1e-20 },
+   { 1e20, 1e20, -1e20 },
+   { 3e38, 1e-38, 0 },
+   { 0, -2e-45, 7e-45 },
+   { 1, 0, 0 }
+};
+
+// State of the random inputs
+static unsigned int random_state = MATH_SEED;
+
+int main(int argc, char *argv[])
+{
+   // Variable declarations
+   int rounds = MATH_ROUNDS;
+   int failed = 0;
+   math_inputs in;
+   math_result results[sizeof(cases) / sizeof(math_case)];
+
+   // Read the optional settings
+   for (int index = 1; index < argc; index++)
+   {
+      if (strncmp(argv[index], "--rounds=", strlen("--rounds=")) == 0 && atoi(argv[index] + strlen("--rounds=")) > 0 &&
+          atoi(argv[index] + strlen("--rounds=")) <= MATH_MAX_ROUNDS)
+      {
+         rounds = atoi(argv[index] + strlen("--rounds="));
+      }
+      else if (strncmp(argv[index], "--seed=", strlen("--seed=")) == 0)
+      {
+         random_state = strtoul(argv[index] + strlen("--seed="), NULL, 10) | 1;
+      }
+      else
+      {
+         fprintf(stderr, "Usage: %s [--rounds=N] [--seed=N]\n", argv[0]);
+         return RUN_FAIL;
+      }
+   }
+
+   // Check every case on the same inputs, a round of eight lanes at a time
+   memset(results, 0, sizeof(results));
+   for (int round = 0; round < rounds; round++)
+   {
+      draw_inputs(&in, round);
+      for (size_t index = 0; index < sizeof(cases) / sizeof(math_case); index++)
+      {
+         cases[index].check(&in, cases[index].allowed, &(results[index]));
+      }
+   }
+
+   // Report each case, failing if any lane was off by more than it allows
+   printf("%-12s %10s %10s %10s %10s\n", "operation", "lanes", "failures", "max ulps", "allowed");
+   for (size_t index = 0; index < sizeof(cases) / sizeof(math_case); index++)
+   {
+      printf("%-12s %10ld %10ld %10d %10d\n", cases[index].name, results[index].lanes, results[index].failures,
+             results[index].worst, cases[index].allowed);
+      failed += results[index].failures > 0;
+   }
+   printf("%d of %d operations match their scalar versions\n", (int)(sizeof(cases) / sizeof(math_case)) - failed,
+          (int)(sizeof(cases) / sizeof(math_case)));
+
+   return failed > 0 ? RUN_FAIL : RUN_SUCCESS;
+}
+
+// Helper method used to draw a seeded random number between low and high
+float math_random(float low, float high)
+{
+   // Step the xorshift state
+   random_state ^= random_state << 13;
+   random_state ^= random_state >> 17;
+   random_state ^= random_state << 5;
+
+   return low + (high - low) * (random_state / 4294967296.0);
+}
+
+// Helper method used to draw a vector whose size is anywhere from denormal to
+// near the top of the float range, with the odd zero component
+void random_vector(ib_v3 *out)
+{
+   // Variable declarations
+   int exponent = MATH_MIN_EXP + (int)math_random(0, MATH_MAX_EXP - MATH_MIN_EXP + 1);
+
+   out->x = math_random(0, 8) < 1 ? 0 : ldexpf(math_random(-1, 1), exponent);
+   out->y = math_random(0, 8) < 1 ? 0 : ldexpf(math_random(-1, 1), exponent);
+   out->z = math_random(0, 8) < 1 ? 0 : ldexpf(math_random(-1, 1), exponent);
+
+   // Keep at least one component, so every vector has a direction
+   if (out->x == 0 && out->y == 0 && out->z == 0)
+   {
+      out->x = ldexpf(1, exponent);
+   }
+}
+
+// Helper method used to fill a round of inputs, starting with the edge vectors
+void draw_inputs(math_inputs *in, int round)
+{
+   for (int lane = 0; lane < 8; lane++)
+   {
+      // Variable declarations
+      ib_v3 scale;
+
+      // Draw each pair, and a scale value the same way
+      if (round == 0)
+      {
+         in->a[lane] = edges[lane];
+      }
+      else
+      {
+         random_vector(&(in->a[lane]));
+      }
+      random_vector(&(in->b[lane]));
+      random_vector(&scale);
+      in->scale[lane] = scale.x;
+
+      // Load them into the wide types
+      ib_v3x8_set(&(in->a8), lane, &(in->a[lane]));
+      ib_v3x8_set(&(in->b8), lane, &(in->b[lane]));
+      in->scale8[lane] = in->scale[lane];
+      if (lane < 4)
+      {
+         ib_v3x4_set(&(in->a4), lane, &(in->a[lane]));
+         ib_v3x4_set(&(in->b4), lane, &(in->b[lane]));
+         in->scale4[lane] = in->scale[lane];
+      }
+   }
+}
+
+// Helper method used to find how many floats lie between two values, counting
+// across zero. Equal bits, or two NaNs, are 0 apart; a NaN and a number are as
+// far apart as can be.
+int float_ulps(float expected, float got)
+{
+   // Variable declarations
+   int32_t first;
+   int32_t second;
+   int64_t distance;
+
+   if (isnan(expected) || isnan(got))
+   {
+      return isnan(expected) && isnan(got) ? 0 : INT_MAX;
+   }
+
+   // Map the bits onto a line that runs through zero
+   memcpy(&first, &expected, sizeof(float));
+   memcpy(&second, &got, sizeof(float));
+   first = first < 0 ? INT32_MIN - first : first;
+   second = second < 0 ? INT32_MIN - second : second;
+   distance = llabs((int64_t)first - second);
+
+   return distance > INT_MAX ? INT_MAX : (int)distance;
+}
+
+// Helper method used to compare the vector in every lane of the wide results
+// with the scalar result for it
+void compare_vectors(ib_v3 *expected, ib_v3x4 *out4, ib_v3x8 *out8, int allowed, math_result *result)
+{
+   for (int lane = 0; lane < 12; lane++)
+   {
+      // Variable declarations
+      ib_v3 got;
+      int ulps;
+
+      // The first eight checks are the eight lane type, the rest the four lane one
+      if (lane < 8)
+      {
+         ib_v3x8_get(&got, out8, lane);
+      }
+      else
+      {
+         ib_v3x4_get(&got, out4, lane - 8);
+      }
+
+      ulps = float_ulps(expected[lane % 8].x, got.x);
+      ulps = ulps > float_ulps(expected[lane % 8].y, got.y) ? ulps : float_ulps(expected[lane % 8].y, got.y);
+      ulps = ulps > float_ulps(expected[lane % 8].z, got.z) ? ulps : float_ulps(expected[lane % 8].z, got.z);
+      result->lanes++;
+      result->failures += ulps > allowed;
+      result->worst = ulps > result->worst ? ulps : result->worst;
+   }
+}
+
+// Helper method used to compare the value in every lane of the wide results
+// with the scalar result for it
+void compare_values(float *expected, ib_f4 *out4, ib_f8 *out8, int allowed, math_result *result)
+{
+   for (int lane = 0; lane < 12; lane++)
+   {
+      // Variable declarations
+      int ulps = float_ulps(expected[lane % 8], lane < 8 ? (*out8)[lane] : (*out4)[lane - 8]);
+
+      result->lanes++;
+      result->failures += ulps > allowed;
+      result->worst = ulps > result->worst ? ulps : result->worst;
+   }
+}
+
+// Helper method used to normalize with the scalar function, scaling the vector
+// by a power of two first when its squared length is not a normal float. The
+// power of two keeps the direction exact, and without it the scalar function
+// divides by zero or infinity.
+void reference_normalize(ib_v3 *v)
+{
+   // Variable declarations
+   float squared = (v->x * v->x) + (v->y * v->y) + (v->z * v->z);
+   float largest = fmaxf(fabsf(v->x), fmaxf(fabsf(v->y), fabsf(v->z)));
+
+   if (squared < FLT_MIN || squared > FLT_MAX)
+   {
+      v->x = ldexpf(v->x, -ilogbf(largest) - 1);
+      v->y = ldexpf(v->y, -ilogbf(largest) - 1);
+      v->z = ldexpf(v->z, -ilogbf(largest) - 1);
+   }
+
+   ib_v3_normalize(v);
+}
+
+// Helper method used to check ib_v3x4_add and ib_v3x8_add against ib_v3_add
+void check_add(math_inputs *in, int allowed, math_result *result)
+{
+   // Variable declarations
+   ib_v3 expected[8];
+   ib_v3x4 out4;
+   ib_v3x8 out8;
+
+   ib_v3x4_add(&out4, &(in->a4), &(in->b4));
+   ib_v3x8_add(&out8, &(in->a8), &(in->b8));
+   for (int lane = 0; lane < 8; lane++)
+   {
+      ib_v3_add(&(expected[lane]), &(in->a[lane]), &(in->b[lane]));
+   }
+   compare_vectors(expected, &out4, &out8, allowed, result);
+}
+
+// Helper method used to check ib_v3x4_sub and ib_v3x8_sub against ib_v3_sub
+void check_sub(math_inputs *in, int allowed, math_result *result)
+{
+   // Variable declarations
+   ib_v3 expected[8];
+   ib_v3x4 out4;
+   ib_v3x8 out8;
+
+   ib_v3x4_sub(&out4, &(in->a4), &(in->b4));
+   ib_v3x8_sub(&out8, &(in->a8), &(in->b8));
+   for (int lane = 0; lane < 8; lane++)
+   {
+      ib_v3_sub(&(expected[lane]), &(in->a[lane]), &(in->b[lane]));
+   }
+   compare_vectors(expected, &out4, &out8, allowed, result);
+}
+
+// Helper method used to check ib_v3x4_mult and ib_v3x8_mult against ib_v3_mult
+void check_mult(math_inputs *in, int allowed, math_result *result)
+{
+   // Variable declarations
+   ib_v3 expected[8];
+   ib_v3x4 out4;
+   ib_v3x8 out8;
+
+   ib_v3x4_mult(&out4, &(in->a4), &(in->b4));
+   ib_v3x8_mult(&out8, &(in->a8), &(in->b8));
+   for (int lane = 0; lane < 8; lane++)
+   {
+      ib_v3_mult(&(expected[lane]), &(in->a[lane]), &(in->b[lane]));
+   }
+   compare_vectors(expected, &out4, &out8, allowed, result);
+}
+
+// Helper method used to check ib_v3x4_scale and ib_v3x8_scale against ib_v3_scale
+void check_scale(math_inputs *in, int allowed, math_result *result)
+{
+   // Variable declarations
+   ib_v3 expected[8];
+   ib_v3x4 out4;
+   ib_v3x8 out8;
+
+   ib_v3x4_scale(&out4, &(in->scale4), &(in->a4));
+   ib_v3x8_scale(&out8, &(in->scale8), &(in->a8));
+   for (int lane = 0; lane < 8; lane++)
+   {
+      ib_v3_scale(&(expected[lane]), in->scale[lane], &(in->a[lane]));
+   }
+   compare_vectors(expected, &out4, &out8, allowed, result);
+}
+
+// Helper method used to check ib_v3x4_dot and ib_v3x8_dot against ib_v3_dot
+void check_dot(math_inputs *in, int allowed, math_result *result)
+{
+   // Variable declarations
+   float expected[8];
+   ib_f4 out4;
+   ib_f8 out8;
+
+   ib_v3x4_dot(&out4, &(in->a4), &(in->b4));
+   ib_v3x8_dot(&out8, &(in->a8), &(in->b8));
+   for (int lane = 0; lane < 8; lane++)
+   {
+      ib_v3_dot(&(expected[lane]), &(in->a[lane]), &(in->b[lane]));
+   }
+   compare_values(expected, &out4, &out8, allowed, result);
+}
+
+// Helper method used to check ib_v3x4_cross and ib_v3x8_cross against
+// ib_v3_cross, writing over the first input as the wide versions allow
+void check_cross(math_inputs *in, int allowed, math_result *result)
+{
+   // Variable declarations
+   ib_v3 expected[8];
+   ib_v3x4 out4 = in->a4;
+   ib_v3x8 out8 = in->a8;
+
+   ib_v3x4_cross(&out4, &out4, &(in->b4));
+   ib_v3x8_cross(&out8, &out8, &(in->b8));
+   for (int lane = 0; lane < 8; lane++)
+   {
+      ib_v3_cross(&(expected[lane]), &(in->a[lane]), &(in->b[lane]));
+   }
+   compare_vectors(expected, &out4, &out8, allowed, result);
+}
+
+// Helper method used to check ib_v3x4_len and ib_v3x8_len against ib_v3_len
+void check_len(math_inputs *in, int allowed, math_result *result)
+{
+   // Variable declarations
+   float expected[8];
+   ib_f4 out4;
+   ib_f8 out8;
+
+   ib_v3x4_len(&out4, &(in->a4));
+   ib_v3x8_len(&out8, &(in->a8));
+   for (int lane = 0; lane < 8; lane++)
+   {
+      ib_v3_len(&(expected[lane]), &(in->a[lane]));
+   }
+   compare_values(expected, &out4, &out8, allowed, result);
+}
+
+// Helper method used to check ib_v3x4_normalize and ib_v3x8_normalize against
+// ib_v3_normalize, on vectors of every size the inputs span
+void check_normalize(math_inputs *in, int allowed, math_result *result)
+{
+   // Variable declarations
+   ib_v3 expected[8];
+   ib_v3x4 out4 = in->a4;
+   ib_v3x8 out8 = in->a8;
+
+   ib_v3x4_normalize(&out4);
+   ib_v3x8_normalize(&out8);
+   for (int lane = 0; lane < 8; lane++)
+   {
+      expected[lane] = in->a[lane];
+      reference_normalize(&(expected[lane]));
+   }
+   compare_vectors(expected, &out4, &out8, allowed, result);
+}
@@ -0,0 +1,17 @@
+#ifndef MATHTEST
+#define MATHTEST
+
+#include "raycast.h"
+
+#define MATH_SEED 2463534242u
+#define MATH_ROUNDS 20000
+#define MATH_MAX_ROUNDS 10000000
+#define MATH_MIN_EXP -140
+#define MATH_MAX_EXP 126
+
+// Normalize multiplies by an rsqrt estimate refined by one Newton step. The
+// estimate's relative error of 1.5 * 2^-12 squares to under 2 ulps, and the
+// rounding of the step, the final multiply and the scalar divide adds up to 4.
+#define MATH_NORMALIZE_ULPS 6
+
+#endif
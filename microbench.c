@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "ib_3dmath.h"
+#include "raycast.h"
+#include "parser.h"
+#include "scene.h"
+#include "isa.h"
+#include "timer.h"
+#include "microbench.h"
+
+// Type definitions
+typedef struct micro_case micro_case;
+typedef struct micro_inputs micro_inputs;
+
+// One measured operation: a loop running it count times over the inputs
+struct micro_case
+{
+   const char *name;
+   void (*run)(int count);
+   int batch;
+};
+
+// Seeded inputs every case cycles through, and a scene for the cases that need one
+struct micro_inputs
+{
+   ib_v3 a[MICRO_INPUTS];
+   ib_v3 b[MICRO_INPUTS];
+   ib_v3 unit[MICRO_INPUTS];
+   ib_v3 r0[MICRO_INPUTS];
+   ib_v3 sphere_rd[MICRO_INPUTS];
+   ib_v3 plane_rd[MICRO_INPUTS];
+   ib_v3 shadow_r0[MICRO_INPUTS];
+   ib_v3 shadow_rd[MICRO_INPUTS];
+   float shadow_dist[MICRO_INPUTS];
+   float light_dist[MICRO_INPUTS];
+   scene scn;
+};
+
+// Forward declarations
+float micro_random(float low, float high);
+void random_unit(ib_v3 *out);
+bool build_inputs(int *result);
+void measure(const micro_case *cur_case, int reps);
+int compare_times(const void *a, const void *b);
+void run_v3_add(int count);
+void run_v3_sub(int count);
+void run_v3_mult(int count);
+void run_v3_scale(int count);
+void run_v3_dot(int count);
+void run_v3_cross(int count);
+void run_v3_len(int count);
+void run_v3_normalize(int count);
+void run_sphere_intersection(int count);
+void run_plane_intersection(int count);
+void run_shadowed(int count);
+void run_shade_light(int count);
+
+// Every case, with how many operations one timed batch runs
+static const micro_case cases[] =
+{
+   { "ib_v3_add", run_v3_add, 65536 },
+   { "ib_v3_sub", run_v3_sub, 65536 },
+   { "ib_v3_mult", run_v3_mult, 65536 },
+   { "ib_v3_scale", run_v3_scale, 65536 },
+   { "ib_v3_dot", run_v3_dot, 65536 },
+   { "ib_v3_cross", run_v3_cross, 65536 },
+   { "ib_v3_len", run_v3_len, 65536 },
+   { "ib_v3_normalize", run_v3_normalize, 65536 },
+   { "sphere_intersection", run_sphere_intersection, 65536 },
+   { "plane_intersection", run_plane_intersection, 65536 },
+   { "shadowed", run_shadowed, 4096 },
+   { "shade_light", run_shade_light, 65536 }
+};
+
+// Inputs, and outputs the cases store to so the compiler cannot drop their work
+static micro_inputs inputs;
+static ib_v3 vector_out[MICRO_INPUTS];
+static float scalar_out[MICRO_INPUTS];
+static rgb color_out[MICRO_INPUTS];
+
+// State of the random inputs
+static unsigned int random_state = MICRO_SEED;
+
+int main(int argc, char *argv[])
+{
+   // Variable declarations
+   char *only = NULL;
+   int reps = MICRO_REPS;
+   int run_result;
+
+   // Read the optional settings
+   for (int index = 1; index < argc; index++)
+   {
+      if (strncmp(argv[index], "--reps=", strlen("--reps=")) == 0 && atoi(argv[index] + strlen("--reps=")) > 0 &&
+          atoi(argv[index] + strlen("--reps=")) <= MICRO_MAX_REPS)
+      {
+         reps = atoi(argv[index] + strlen("--reps="));
+      }
+      else if (strncmp(argv[index], "--seed=", strlen("--seed=")) == 0)
+      {
+         random_state = strtoul(argv[index] + strlen("--seed="), NULL, 10) | 1;
+      }
+      else if (strncmp(argv[index], "--only=", strlen("--only=")) == 0)
+      {
+         only = argv[index] + strlen("--only=");
+      }
+      else
+      {
+         fprintf(stderr, "Usage: %s [--reps=N] [--seed=N] [--only=PREFIX]\n", argv[0]);
+         return RUN_FAIL;
+      }
+   }
+
+   // Use the same kernels the raycaster would pick, on the same inputs every run
+   select_kernels(ISA_AUTO);
+   if (build_inputs(&run_result) == FALSE)
+   {
+      fprintf(stderr, "Error: Could not build the benchmark scene. (err no. %d)\n", run_result);
+      return RUN_FAIL;
+   }
+
+   // Time every case that was asked for
+   printf("%-20s %10s %10s %10s %10s %10s\n", "operation", "min ns", "median ns", "p99 ns", "mean ns", "Mops/s");
+   for (size_t index = 0; index < sizeof(cases) / sizeof(micro_case); index++)
+   {
+      if (only == NULL || strncmp(cases[index].name, only, strlen(only)) == 0)
+      {
+         measure(&cases[index], reps);
+      }
+   }
+
+   free_scene(&(inputs.scn));
+   return RUN_SUCCESS;
+}
+
+// Helper method used to draw a seeded random number between low and high
+float micro_random(float low, float high)
+{
+   // Step the xorshift state
+   random_state ^= random_state << 13;
+   random_state ^= random_state >> 17;
+   random_state ^= random_state << 5;
+
+   return low + (high - low) * (random_state / 4294967296.0);
+}
+
+// Helper method used to draw a random direction
+void random_unit(ib_v3 *out)
+{
+   do
+   {
+      out->x = micro_random(-1, 1);
+      out->y = micro_random(-1, 1);
+      out->z = micro_random(-1, 1);
+   } while (out->x * out->x + out->y * out->y + out->z * out->z < 0.01);
+
+   ib_v3_normalize(out);
+}
+
+// Helper method used to write a random scene through the parser, as the
+// raycaster would load it, and to draw the inputs every case works through.
+// Sphere rays aim near their sphere so about half hit, and shadow rays run from
+// points in the scene to its lights.
+bool build_inputs(int *result)
+{
+   // Variable declarations
+   linked_list objs = { malloc(sizeof(obj_node)), malloc(sizeof(obj_node)), malloc(sizeof(obj_node)), 0 };
+   char scene_name[] = MICRO_SCENE_TEMPLATE;
+   int scene_fd = mkstemp(scene_name);
+   FILE *out = scene_fd >= 0 ? fdopen(scene_fd, "w") : NULL;
+   scene *scn = &(inputs.scn);
+
+   *result = RUN_FAIL;
+   if (out == NULL)
+   {
+      return FALSE;
+   }
+
+   // A cloud of spheres with floor, back and side planes, lit by point and spot lights
+   fprintf(out, "camera, width: 2.0, height: 2.0\n");
+   for (int index = 0; index < MICRO_SPHERES; index++)
+   {
+      fprintf(out, "sphere, position: [%.3f, %.3f, %.3f], radius: %.3f, specular_color: [1, 1, 1], "
+                   "diffuse_color: [%.2f, %.2f, %.2f], reflectivity: 0.3, refractivity: 0.1, ior: 1.5\n",
+              micro_random(-20, 20), micro_random(-10, 10), micro_random(-60, -20), micro_random(0.2, 1.2),
+              micro_random(0, 1), micro_random(0, 1), micro_random(0, 1));
+   }
+   fprintf(out, "plane, position: [0, -12, 0], normal: [0, 1, 0], diffuse_color: [0.5, 0.5, 0.5]\n");
+   fprintf(out, "plane, position: [0, 0, -70], normal: [0, 0, 1], diffuse_color: [0.3, 0.3, 0.6]\n");
+   fprintf(out, "plane, position: [-25, 0, 0], normal: [1, 0, 0], diffuse_color: [0.6, 0.3, 0.3]\n");
+   fprintf(out, "plane, position: [25, 0, 0], normal: [-1, 0, 0], diffuse_color: [0.3, 0.6, 0.3]\n");
+   fprintf(out, "light, color: [2, 2, 2], theta: 0, radial-a2: 0.001, radial-a1: 0.01, radial-a0: 0.5, position: [0, 15, -40]\n");
+   fprintf(out, "light, color: [1, 1, 1], theta: 0, radial-a2: 0.001, radial-a1: 0.01, radial-a0: 0.5, position: [-15, 5, -10]\n");
+   fprintf(out, "light, color: [2, 2, 2], theta: 30, radial-a2: 0.001, radial-a1: 0.01, radial-a0: 0.5, position: [15, 10, -20], "
+                "direction: [-0.5, -0.5, -1], angular-a0: 0.5\n");
+   fprintf(out, "light, color: [1, 1, 1], theta: 45, radial-a2: 0.001, radial-a1: 0.01, radial-a0: 0.5, position: [0, 0, 0], "
+                "direction: [0, 0, -1], angular-a0: 0.2\n");
+   fclose(out);
+
+   // Load it the way the raycaster does, then drop the file
+   parse(&objs, scene_name, result);
+   unlink(scene_name);
+   if (*result != RUN_SUCCESS)
+   {
+      return FALSE;
+   }
+   compile_scene(scn, &objs);
+
+   // Draw the inputs
+   for (int index = 0; index < MICRO_INPUTS; index++)
+   {
+      // Variable declarations
+      int sphere = index % scn->spheres.count;
+      light *cur_light = &(scn->lights[index % scn->light_count]);
+      ib_v3 aim;
+
+      inputs.a[index].x = micro_random(-10, 10);
+      inputs.a[index].y = micro_random(-10, 10);
+      inputs.a[index].z = micro_random(-10, 10);
+      inputs.b[index].x = micro_random(-10, 10);
+      inputs.b[index].y = micro_random(-10, 10);
+      inputs.b[index].z = micro_random(-10, 10);
+      random_unit(&(inputs.unit[index]));
+
+      // Rays from near the camera, aimed within twice the radius of their sphere
+      inputs.r0[index].x = micro_random(-2, 2);
+      inputs.r0[index].y = micro_random(-2, 2);
+      inputs.r0[index].z = micro_random(-2, 2);
+      aim.x = scn->spheres.x[sphere] + micro_random(-2, 2) * sqrtf(scn->spheres.radius2[sphere]) - inputs.r0[index].x;
+      aim.y = scn->spheres.y[sphere] + micro_random(-2, 2) * sqrtf(scn->spheres.radius2[sphere]) - inputs.r0[index].y;
+      aim.z = scn->spheres.z[sphere] - inputs.r0[index].z;
+      ib_v3_normalize(&aim);
+      inputs.sphere_rd[index] = aim;
+      random_unit(&(inputs.plane_rd[index]));
+
+      // Shadow rays from a point in the cloud towards a light
+      inputs.shadow_r0[index].x = micro_random(-20, 20);
+      inputs.shadow_r0[index].y = micro_random(-10, 10);
+      inputs.shadow_r0[index].z = micro_random(-60, -20);
+      ib_v3_sub(&aim, &(cur_light->position), &(inputs.shadow_r0[index]));
+      ib_v3_len(&(inputs.shadow_dist[index]), &aim);
+      ib_v3_normalize(&aim);
+      inputs.shadow_rd[index] = aim;
+      inputs.light_dist[index] = micro_random(1, 60);
+   }
+
+   return TRUE;
+}
+
+// Helper method used to time a case: warm it up, then time reps batches and
+// report per operation the fastest, median, 99th percentile and mean batch,
+// with the throughput the median gives
+void measure(const micro_case *cur_case, int reps)
+{
+   // Variable declarations
+   double *times = malloc(sizeof(double) * reps);
+   double total = 0;
+   double start;
+   int p99 = (int)ceil(MICRO_P99 * reps) - 1;
+
+   // Bring code and inputs into cache, and the clock up to speed
+   for (int rep = 0; rep < MICRO_WARMUP; rep++)
+   {
+      cur_case->run(cur_case->batch);
+   }
+
+   // Time each batch on its own
+   for (int rep = 0; rep < reps; rep++)
+   {
+      start = ib_now();
+      cur_case->run(cur_case->batch);
+      times[rep] = (ib_now() - start) * 1e9 / cur_case->batch;
+      total += times[rep];
+   }
+
+   qsort(times, reps, sizeof(double), compare_times);
+   printf("%-20s %10.2f %10.2f %10.2f %10.2f %10.1f\n", cur_case->name, times[0], times[reps / 2], times[p99], total / reps,
+          1e3 / times[reps / 2]);
+   fflush(stdout);
+   free(times);
+}
+
+// Helper method used to compare two batch times for qsort
+int compare_times(const void *a, const void *b)
+{
+   // Variable declarations
+   double first = *(const double *)a;
+   double second = *(const double *)b;
+
+   return (first > second) - (first < second);
+}
+
+// Helper method used as the ib_v3_add case
+void run_v3_add(int count)
+{
+   for (int index = 0; index < count; index++)
+   {
+      ib_v3_add(&(vector_out[index & MICRO_INPUT_MASK]), &(inputs.a[index & MICRO_INPUT_MASK]), &(inputs.b[index & MICRO_INPUT_MASK]));
+   }
+}
+
+// Helper method used as the ib_v3_sub case
+void run_v3_sub(int count)
+{
+   for (int index = 0; index < count; index++)
+   {
+      ib_v3_sub(&(vector_out[index & MICRO_INPUT_MASK]), &(inputs.a[index & MICRO_INPUT_MASK]), &(inputs.b[index & MICRO_INPUT_MASK]));
+   }
+}
+
+// Helper method used as the ib_v3_mult case
+void run_v3_mult(int count)
+{
+   for (int index = 0; index < count; index++)
+   {
+      ib_v3_mult(&(vector_out[index & MICRO_INPUT_MASK]), &(inputs.a[index & MICRO_INPUT_MASK]), &(inputs.b[index & MICRO_INPUT_MASK]));
+   }
+}
+
+// Helper method used as the ib_v3_scale case
+void run_v3_scale(int count)
+{
+   for (int index = 0; index < count; index++)
+   {
+      ib_v3_scale(&(vector_out[index & MICRO_INPUT_MASK]), inputs.b[index & MICRO_INPUT_MASK].x, &(inputs.a[index & MICRO_INPUT_MASK]));
+   }
+}
+
+// Helper method used as the ib_v3_dot case
+void run_v3_dot(int count)
+{
+   for (int index = 0; index < count; index++)
+   {
+      ib_v3_dot(&(scalar_out[index & MICRO_INPUT_MASK]), &(inputs.a[index & MICRO_INPUT_MASK]), &(inputs.b[index & MICRO_INPUT_MASK]));
+   }
+}
+
+// Helper method used as the ib_v3_cross case
+void run_v3_cross(int count)
+{
+   for (int index = 0; index < count; index++)
+   {
+      ib_v3_cross(&(vector_out[index & MICRO_INPUT_MASK]), &(inputs.a[index & MICRO_INPUT_MASK]), &(inputs.b[index & MICRO_INPUT_MASK]));
+   }
+}
+
+// Helper method used as the ib_v3_len case
+void run_v3_len(int count)
+{
+   for (int index = 0; index < count; index++)
+   {
+      ib_v3_len(&(scalar_out[index & MICRO_INPUT_MASK]), &(inputs.a[index & MICRO_INPUT_MASK]));
+   }
+}
+
+// Helper method used as the ib_v3_normalize case, normalizing a copy so the
+// inputs stay the same every batch
+void run_v3_normalize(int count)
+{
+   for (int index = 0; index < count; index++)
+   {
+      vector_out[index & MICRO_INPUT_MASK] = inputs.a[index & MICRO_INPUT_MASK];
+      ib_v3_normalize(&(vector_out[index & MICRO_INPUT_MASK]));
+   }
+}
+
+// Helper method used as the sphere_intersection case, each ray against the sphere it aims near
+void run_sphere_intersection(int count)
+{
+   for (int index = 0; index < count; index++)
+   {
+      // Variable declarations
+      int input = index & MICRO_INPUT_MASK;
+
+      scalar_out[input] = INFINITY;
+      sphere_intersection(&(inputs.r0[input]), &(inputs.sphere_rd[input]), &(inputs.scn.spheres), input % inputs.scn.spheres.count,
+                          &(scalar_out[input]));
+   }
+}
+
+// Helper method used as the plane_intersection case, each ray in a random direction
+void run_plane_intersection(int count)
+{
+   for (int index = 0; index < count; index++)
+   {
+      // Variable declarations
+      int input = index & MICRO_INPUT_MASK;
+
+      scalar_out[input] = INFINITY;
+      plane_intersection(&(inputs.r0[input]), &(inputs.plane_rd[input]), &(inputs.scn.planes), input % inputs.scn.planes.count,
+                         &(scalar_out[input]));
+   }
+}
+
+// Helper method used as the shadowed case, each shadow ray against the whole scene
+void run_shadowed(int count)
+{
+   for (int index = 0; index < count; index++)
+   {
+      // Variable declarations
+      int input = index & MICRO_INPUT_MASK;
+      int skip = -1;
+      int blocker;
+
+      scalar_out[input] = shadowed(&(inputs.shadow_r0[input]), &(inputs.shadow_rd[input]), &(inputs.shadow_dist[input]), &skip,
+                                   &(inputs.scn), &blocker);
+   }
+}
+
+// Helper method used as the shade_light case, the Phong diffuse and specular
+// terms of one light at a hit
+void run_shade_light(int count)
+{
+   for (int index = 0; index < count; index++)
+   {
+      // Variable declarations
+      int input = index & MICRO_INPUT_MASK;
+
+      color_out[input] = shade_light(&(inputs.scn.lights[input % inputs.scn.light_count]),
+                                     &(inputs.scn.materials[input % inputs.scn.spheres.count]), &(inputs.unit[input]),
+                                     &(inputs.plane_rd[input]), &(inputs.shadow_rd[input]), inputs.light_dist[input]);
+   }
+}
@@ -0,0 +1,16 @@
+#ifndef MICROBENCH
+#define MICROBENCH
+
+#include "raycast.h"
+
+#define MICRO_SEED 2463534242u
+#define MICRO_INPUTS 4096
+#define MICRO_INPUT_MASK (MICRO_INPUTS - 1)
+#define MICRO_REPS 101
+#define MICRO_MAX_REPS 10001
+#define MICRO_WARMUP 5
+#define MICRO_SPHERES 1000
+#define MICRO_SCENE_TEMPLATE "/tmp/raymicro-XXXXXX"
+#define MICRO_P99 0.99
+
+#endif
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raycast.h"
+#include "options.h"
+#include "tiles.h"
+#include "packet.h"
+#include "isa.h"
+
+// Method used to parse the optional "--name=value" arguments after the required ones
+void parse_options(options *opts, int argc, char *argv[], int *result)
+{
+   // Start with the default settings
+   opts->shade_mode = SHADE_PER_LIGHT;
+   opts->threads = default_thread_count();
+   opts->tile_size = TILE_SIZE_DEFAULT;
+   opts->stats = STATS_NONE;
+   opts->packet = PACKET_OFF;
+   opts->isa = ISA_AUTO;
+   opts->prune = PRUNE_OFF;
+   opts->max_depth = MAX_RECURSION;
+   opts->sort = SORT_OFF;
+   opts->heatmap = HEATMAP_OFF;
+   *result = RUN_SUCCESS;
+
+   // Loop through each remaining argument
+   for (int index = MIN_ARGS; index < argc; index++)
+   {
+      // Variable declarations
+      char *name = argv[index];
+      char *value = strchr(name, OPTION_SEP);
+
+      // Every option must look like --name=value
+      if (strncmp(name, OPTION_PREFIX, strlen(OPTION_PREFIX)) != 0 || value == NULL)
+      {
+         fprintf(stderr, "Error: Unrecognized option \"%s\". (err no. %d)\n", name, OPTION_INVALID);
+         *result = OPTION_INVALID;
+         return;
+      }
+
+      // Split the name from the value
+      name += strlen(OPTION_PREFIX);
+      value++;
+
+      // Compare option name
+      if (strncmp(name, "shade=", value - name) == 0)
+      {
+         if (strcmp(value, "per-light") == 0)
+         {
+            opts->shade_mode = SHADE_PER_LIGHT;
+         }
+         else if (strcmp(value, "once") == 0)
+         {
+            opts->shade_mode = SHADE_ONCE;
+         }
+         else
+         {
+            *result = OPTION_INVALID;
+         }
+      }
+      else if (strncmp(name, "threads=", value - name) == 0)
+      {
+         opts->threads = atoi(value);
+         if (opts->threads <= 0)
+         {
+            *result = OPTION_INVALID;
+         }
+      }
+      else if (strncmp(name, "tile=", value - name) == 0)
+      {
+         opts->tile_size = atoi(value);
+         if (opts->tile_size <= 0)
+         {
+            *result = OPTION_INVALID;
+         }
+      }
+      else if (strncmp(name, "stats=", value - name) == 0)
+      {
+         if (strcmp(value, "none") == 0)
+         {
+            opts->stats = STATS_NONE;
+         }
+         else if (strcmp(value, "text") == 0)
+         {
+            opts->stats = STATS_TEXT;
+         }
+         else if (strcmp(value, "json") == 0)
+         {
+            opts->stats = STATS_JSON;
+         }
+         else
+         {
+            *result = OPTION_INVALID;
+         }
+      }
+      else if (strncmp(name, "packet=", value - name) == 0)
+      {
+         opts->packet = atoi(value);
+         if (packet_width_valid(opts->packet, ISA_AVX512) == FALSE)
+         {
+            *result = OPTION_INVALID;
+         }
+      }
+      else if (strncmp(name, "isa=", value - name) == 0)
+      {
+         opts->isa = isa_level(value);
+         if (opts->isa < 0 || (opts->isa != ISA_AUTO && isa_supported(opts->isa) == FALSE))
+         {
+            *result = OPTION_INVALID;
+         }
+      }
+      else if (strncmp(name, "prune=", value - name) == 0)
+      {
+         if (strcmp(value, "off") == 0)
+         {
+            opts->prune = PRUNE_OFF;
+         }
+         else if (strcmp(value, "adaptive") == 0)
+         {
+            opts->prune = PRUNE_ADAPTIVE;
+         }
+         else
+         {
+            *result = OPTION_INVALID;
+         }
+      }
+      else if (strncmp(name, "sort=", value - name) == 0)
+      {
+         if (strcmp(value, "off") == 0)
+         {
+            opts->sort = SORT_OFF;
+         }
+         else if (strcmp(value, "on") == 0)
+         {
+            opts->sort = SORT_ON;
+         }
+         else
+         {
+            *result = OPTION_INVALID;
+         }
+      }
+      else if (strncmp(name, "heatmap=", value - name) == 0)
+      {
+         if (strcmp(value, "off") == 0)
+         {
+            opts->heatmap = HEATMAP_OFF;
+         }
+         else if (strcmp(value, "rays") == 0)
+         {
+            opts->heatmap = HEATMAP_RAYS;
+         }
+         else if (strcmp(value, "cycles") == 0)
+         {
+            opts->heatmap = HEATMAP_CYCLES;
+         }
+         else
+         {
+            *result = OPTION_INVALID;
+         }
+      }
+      else if (strncmp(name, "max-depth=", value - name) == 0)
+      {
+         opts->max_depth = atoi(value);
+         if (opts->max_depth < 0 || opts->max_depth > MAX_DEPTH_LIMIT)
+         {
+            *result = OPTION_INVALID;
+         }
+      }
+      else
+      {
+         *result = OPTION_INVALID;
+      }
+
+      // Stop at the first bad option
+      if (*result != RUN_SUCCESS)
+      {
+         fprintf(stderr, "Error: Invalid option \"%s\". (err no. %d)\n", argv[index], OPTION_INVALID);
+         return;
+      }
+   }
+
+   // Use the best level this CPU has unless one was forced
+   if (opts->isa == ISA_AUTO)
+   {
+      opts->isa = detect_isa();
+   }
+
+   // Packets wider than the chosen level can run are refused
+   if (packet_width_valid(opts->packet, opts->isa) == FALSE)
+   {
+      fprintf(stderr, "Error: Packets of %d rays need a newer instruction set than %s. (err no. %d)\n", opts->packet, isa_name(opts->isa), OPTION_INVALID);
+      *result = OPTION_INVALID;
+   }
+}
@@ -0,0 +1,13 @@
+#ifndef OPTIONS
+#define OPTIONS
+
+#include "raycast.h"
+
+#define OPTION_PREFIX "--"
+#define OPTION_SEP '='
+#define OPTION_INVALID 5
+
+// Public function declarations
+void parse_options(options *opts, int argc, char *argv[], int *result);
+
+#endif
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ib_3dmath.h"
+#include "raycast.h"
+#include "bvh.h"
+#include "packet.h"
+#include "isa.h"
+#include "stats.h"
+
+// Vector types for each packet width. Widths the target has no registers for
+// are split by the compiler into narrower operations.
+typedef float v4sf __attribute__((vector_size(16)));
+typedef int v4si __attribute__((vector_size(16)));
+typedef float v8sf __attribute__((vector_size(32)));
+typedef int v8si __attribute__((vector_size(32)));
+typedef float v16sf __attribute__((vector_size(64)));
+typedef int v16si __attribute__((vector_size(64)));
+
+// Kernel for 4-ray packets (SSE)
+#define PACKET_LANES 4
+#define PACKET_FLOAT v4sf
+#define PACKET_INT v4si
+#define PACKET_NAME(name) name##_4
+#include "packet_kernel.h"
+#undef PACKET_LANES
+#undef PACKET_FLOAT
+#undef PACKET_INT
+#undef PACKET_NAME
+
+// Kernel for 8-ray packets, built for AVX2
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define PACKET_LANES 8
+#define PACKET_FLOAT v8sf
+#define PACKET_INT v8si
+#define PACKET_NAME(name) name##_8
+#include "packet_kernel.h"
+#undef PACKET_LANES
+#undef PACKET_FLOAT
+#undef PACKET_INT
+#undef PACKET_NAME
+#pragma GCC pop_options
+
+// Kernel for 16-ray packets, built for AVX-512
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#define PACKET_LANES 16
+#define PACKET_FLOAT v16sf
+#define PACKET_INT v16si
+#define PACKET_NAME(name) name##_16
+#include "packet_kernel.h"
+#undef PACKET_LANES
+#undef PACKET_FLOAT
+#undef PACKET_INT
+#undef PACKET_NAME
+#pragma GCC pop_options
+
+// Method used to check that a packet width is off or has a kernel that both
+// this CPU and the given instruction set level can run
+bool packet_width_valid(int lanes, int level)
+{
+   return lanes == PACKET_OFF || lanes == 4 ||
+          (lanes == 8 && level >= ISA_AVX2 && isa_supported(ISA_AVX2)) ||
+          (lanes == 16 && level >= ISA_AVX512 && isa_supported(ISA_AVX512));
+}
+
+// Method used to find the block of pixels a packet covers, kept close to square
+// so its rays stay coherent
+void packet_shape(int lanes, int *width, int *height)
+{
+   *width = lanes >= 8 ? 4 : lanes >= 4 ? 2 : 1;
+   *height = lanes / *width;
+}
+
+// Method used to trace a packet with the kernel for its width
+void packet_closest(scene *scn, ray_packet *packet, int lanes)
+{
+   if (lanes == 16)
+   {
+      packet_closest_16(scn, packet);
+   }
+   else if (lanes == 8)
+   {
+      packet_closest_8(scn, packet);
+   }
+   else
+   {
+      packet_closest_4(scn, packet);
+   }
+}
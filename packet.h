@@ -0,0 +1,13 @@
+#ifndef PACKET
+#define PACKET
+
+#include "raycast.h"
+
+#define PACKET_OFF 1
+
+// Public function declarations
+bool packet_width_valid(int lanes, int level);
+void packet_closest(scene *scn, ray_packet *packet, int lanes);
+void packet_shape(int lanes, int *width, int *height);
+
+#endif
@@ -0,0 +1,230 @@
+// Packet kernel for one width. packet.c includes this file once per width with
+// PACKET_LANES, PACKET_FLOAT, PACKET_INT and PACKET_NAME defined, so it
+// deliberately has no include guard.
+
+// Helper function used to load a packet array into a vector
+static inline PACKET_FLOAT PACKET_NAME(load)(const float *values)
+{
+   // Variable declarations
+   PACKET_FLOAT out;
+
+   memcpy(&out, values, sizeof(PACKET_FLOAT));
+   return out;
+}
+
+// Helper function used to pick a where mask is set and b everywhere else
+static inline PACKET_FLOAT PACKET_NAME(select)(PACKET_INT mask, PACKET_FLOAT a, PACKET_FLOAT b)
+{
+   return (PACKET_FLOAT)((mask & (PACKET_INT)a) | (~mask & (PACKET_INT)b));
+}
+
+// Helper function used to check whether any lane of a mask is set
+static inline bool PACKET_NAME(any)(PACKET_INT mask)
+{
+   for (int lane = 0; lane < PACKET_LANES; lane++)
+   {
+      if (mask[lane] != 0)
+      {
+         return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+// Helper functions used to take the smaller or larger value per lane. Like fminf
+// and fmaxf, a NaN in b gives back a, so boxes behave exactly as in ray_box.
+static inline PACKET_FLOAT PACKET_NAME(min)(PACKET_FLOAT a, PACKET_FLOAT b)
+{
+   return PACKET_NAME(select)((a < b) | (b != b), a, b);
+}
+
+static inline PACKET_FLOAT PACKET_NAME(max)(PACKET_FLOAT a, PACKET_FLOAT b)
+{
+   return PACKET_NAME(select)((a > b) | (b != b), a, b);
+}
+
+// Helper function used to take the square root of every lane
+static inline PACKET_FLOAT PACKET_NAME(sqrt)(PACKET_FLOAT value)
+{
+#ifdef __SSE__
+   // Variable declarations
+   v4sf quarters[PACKET_LANES / 4];
+
+   // Work through the vector four lanes at a time
+   memcpy(quarters, &value, sizeof(PACKET_FLOAT));
+   for (int index = 0; index < PACKET_LANES / 4; index++)
+   {
+      quarters[index] = __builtin_ia32_sqrtps(quarters[index]);
+   }
+   memcpy(&value, quarters, sizeof(PACKET_FLOAT));
+#else
+   for (int lane = 0; lane < PACKET_LANES; lane++)
+   {
+      value[lane] = sqrtf(value[lane]);
+   }
+#endif
+
+   return value;
+}
+
+// Helper function used to test a box against every lane, following ray_box exactly
+static inline PACKET_INT PACKET_NAME(box)(aabb *box, PACKET_FLOAT *origin, PACKET_FLOAT *inv, PACKET_FLOAT max_t)
+{
+   // Variable declarations
+   PACKET_FLOAT tx0 = (box->min.x - origin[0]) * inv[0];
+   PACKET_FLOAT tx1 = (box->max.x - origin[0]) * inv[0];
+   PACKET_FLOAT ty0 = (box->min.y - origin[1]) * inv[1];
+   PACKET_FLOAT ty1 = (box->max.y - origin[1]) * inv[1];
+   PACKET_FLOAT tz0 = (box->min.z - origin[2]) * inv[2];
+   PACKET_FLOAT tz1 = (box->max.z - origin[2]) * inv[2];
+   PACKET_FLOAT t_near = PACKET_NAME(max)(PACKET_NAME(max)(PACKET_NAME(min)(tx0, tx1), PACKET_NAME(min)(ty0, ty1)),
+                                          PACKET_NAME(min)(tz0, tz1));
+   PACKET_FLOAT t_far = PACKET_NAME(min)(PACKET_NAME(min)(PACKET_NAME(max)(tx0, tx1), PACKET_NAME(max)(ty0, ty1)),
+                                         PACKET_NAME(max)(tz0, tz1));
+
+   return (t_far >= t_near) & (t_far > 0) & (t_near <= max_t);
+}
+
+// Helper function used to intersect one sphere with every lane, following
+// sphere_intersection exactly. Lanes that miss get INFINITY.
+static inline PACKET_FLOAT PACKET_NAME(sphere)(sphere_set *spheres, int index, PACKET_FLOAT *origin, PACKET_FLOAT *dir)
+{
+   // Variable declarations
+   PACKET_FLOAT ox = origin[0] - spheres->x[index];
+   PACKET_FLOAT oy = origin[1] - spheres->y[index];
+   PACKET_FLOAT oz = origin[2] - spheres->z[index];
+   PACKET_FLOAT a = (dir[0] * dir[0]) + (dir[1] * dir[1]) + (dir[2] * dir[2]);
+   PACKET_FLOAT b = dir[0] * ox + dir[1] * oy + dir[2] * oz;
+   PACKET_FLOAT c = (ox * ox + oy * oy + oz * oz) - spheres->radius2[index];
+   PACKET_FLOAT d = b * b - a * c;
+   PACKET_INT hit = d > 0;
+   PACKET_FLOAT t = (PACKET_FLOAT){ 0 } + INFINITY;
+   PACKET_FLOAT root;
+   PACKET_FLOAT t0;
+   PACKET_FLOAT t1;
+
+   // Only work out the roots if some lane can use them
+   if (PACKET_NAME(any)(hit) == FALSE)
+   {
+      return t;
+   }
+
+   // Calculate both t values, preferring the nearer one in front of the origin
+   root = PACKET_NAME(sqrt)(d);
+   t0 = (-b + root) / a;
+   t1 = (-b - root) / a;
+   t = PACKET_NAME(select)(hit & (t0 > 0), t0, t);
+   return PACKET_NAME(select)(hit & (t1 > 0), t1, t);
+}
+
+// Method used to find the closest primitive for every active lane of a packet,
+// giving the same t and primitive id as bvh_closest for each ray
+void PACKET_NAME(packet_closest)(scene *scn, ray_packet *packet)
+{
+   // Variable declarations
+   bvh *tree = &(scn->tree);
+   int stack[BVH_STACK_SIZE];
+   int stack_size = 0;
+   PACKET_FLOAT zero = { 0 };
+   PACKET_FLOAT origin[3] = { zero + packet->ox, zero + packet->oy, zero + packet->oz };
+   PACKET_FLOAT dir[3] = { PACKET_NAME(load)(packet->dx), PACKET_NAME(load)(packet->dy), PACKET_NAME(load)(packet->dz) };
+   PACKET_FLOAT inv[3] = { PACKET_NAME(load)(packet->inv_dx), PACKET_NAME(load)(packet->inv_dy), PACKET_NAME(load)(packet->inv_dz) };
+   PACKET_INT active;
+   PACKET_INT hit;
+   PACKET_INT mask;
+   PACKET_INT take;
+   PACKET_FLOAT t = zero + INFINITY;
+   PACKET_FLOAT cur_t;
+   ib_v3 mean = { 0, 0, 0 };
+
+   // Start with no hit on any lane
+   memcpy(&active, packet->active, sizeof(PACKET_INT));
+   hit = (PACKET_INT){ 0 } - 1;
+
+   // Children are visited in the order the average active ray meets them
+   for (int lane = 0; lane < PACKET_LANES; lane++)
+   {
+      if (packet->active[lane] != 0)
+      {
+         mean.x += packet->dx[lane];
+         mean.y += packet->dy[lane];
+         mean.z += packet->dz[lane];
+      }
+   }
+
+   // Walk the tree once for the whole packet, masking off lanes that miss a node
+   if (tree->node_count > 0)
+   {
+      stack[stack_size++] = 0;
+   }
+   while (stack_size > 0)
+   {
+      // Variable declarations
+      int node_index = stack[--stack_size];
+      bvh_node *node = &(tree->nodes[node_index]);
+
+      // Skip nodes no lane can still find a closer hit in
+      STAT_ADD(box_tests, PACKET_LANES);
+      mask = PACKET_NAME(box)(&(node->bounds), origin, inv, t) & active;
+      if (PACKET_NAME(any)(mask) == FALSE)
+      {
+         continue;
+      }
+
+      // Test every sphere in a leaf, keeping the lowest id on ties like bvh_closest
+      if (node->count > 0)
+      {
+         STAT_ADD(sphere_tests, node->count * PACKET_LANES);
+         for (int index = node->left_first; index < node->left_first + node->count; index++)
+         {
+            cur_t = PACKET_NAME(sphere)(&(scn->spheres), index, origin, dir);
+            take = mask & ((cur_t < t) | ((cur_t == t) & (index < hit)));
+            t = PACKET_NAME(select)(take, cur_t, t);
+            hit = (take & index) | (~take & hit);
+         }
+      }
+      // Otherwise, push the far child first so the near one is visited next
+      else
+      {
+         // Variable declarations
+         aabb *left = &(tree->nodes[node->left_first].bounds);
+         aabb *right = &(tree->nodes[node->left_first + 1].bounds);
+         float toward_right = (right->min.x + right->max.x - left->min.x - left->max.x) * mean.x +
+                              (right->min.y + right->max.y - left->min.y - left->max.y) * mean.y +
+                              (right->min.z + right->max.z - left->min.z - left->max.z) * mean.z;
+
+         if (toward_right >= 0)
+         {
+            stack[stack_size++] = node->left_first + 1;
+            stack[stack_size++] = node->left_first;
+         }
+         else
+         {
+            stack[stack_size++] = node->left_first;
+            stack[stack_size++] = node->left_first + 1;
+         }
+      }
+   }
+
+   // Planes are unbounded, so test them directly
+   STAT_ADD(plane_tests, scn->planes.count * PACKET_LANES);
+   for (int index = 0; index < scn->planes.count; index++)
+   {
+      // Variable declarations
+      float a = scn->planes.nx[index];
+      float b = scn->planes.ny[index];
+      float c = scn->planes.nz[index];
+      PACKET_FLOAT den = a * dir[0] + b * dir[1] + c * dir[2];
+
+      // A ray parallel to the plane gets the same faulty t as plane_intersection
+      cur_t = PACKET_NAME(select)(den == 0, zero - 1, -(a * origin[0] + b * origin[1] + c * origin[2] + scn->planes.d[index]) / den);
+      take = active & (cur_t < t) & (cur_t > 0);
+      t = PACKET_NAME(select)(take, cur_t, t);
+      hit = (take & (scn->spheres.count + index)) | (~take & hit);
+   }
+
+   // Store the results
+   memcpy(packet->t, &t, sizeof(PACKET_FLOAT));
+   memcpy(packet->hit, &hit, sizeof(PACKET_INT));
+}
@@ -3,569 +3,275 @@
 #include <string.h>
 #include <math.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "ib_3dmath.h"
 #include "raycast.h"
 #include "parser.h"
 
 // Forward declarations
-void store_obj_properties(obj *cur_obj, FILE *file, char *c, int *result);
-void get_next_word(char *word, char delim, int max_len, FILE *file, char *c);
-void get_camera(obj *cur_obj, FILE *file, char *c, int *result);
-void get_sphere(obj *cur_obj, FILE *file, char *c, int *result);
-void get_plane(obj *cur_obj, FILE *file, char *c, int *result);
-void get_light(obj *cur_obj, FILE *file, char *c, int *result);
+void store_obj_properties(obj *cur_obj, source *src, char *c, int *result);
+void get_next_token(token *word, char delim, source *src, char *c);
+void get_next_value(double *value, char delim, source *src, char *c);
+double parse_number(const char *start, const char *end, const char **stop);
+void finish_token(const char *cur, source *src, char *c);
+void get_properties(obj *cur_obj, const object_schema *schema, source *src, char *c, int *result);
+bool read_field(obj *cur_obj, const field_slot *slot, source *src, char *c, unsigned int *found);
+bool store_value(float *target, const field_spec *field, double value);
+bool check_groups(obj *cur_obj, const object_schema *schema, unsigned int found);
+bool check_light(obj *cur_obj, unsigned int found, const unsigned int *masks);
+unsigned int hash_key(int type, const char *text, int len);
+void build_field_table();
+const field_slot *find_field(const object_schema *schema, token *property);
+
+// Camera properties, both required
+static const field_spec camera_fields[] =
+{
+   { "width", offsetof(obj, width), 1, 0, 0, 0, 0 },
+   { "height", offsetof(obj, height), 1, 0, 0, 0, 1 }
+};
+static const int camera_groups[] = { GROUP_REQUIRED, GROUP_REQUIRED };
+
+// Sphere properties; color and the reflect/refract/ior trio are optional
+static const field_spec sphere_fields[] =
+{
+   { "color", offsetof(obj, color), 3, FIELD_MIN | FIELD_MAX | FIELD_STRICT, 0, 1, 0 },
+   { "position", offsetof(obj, position), 3, 0, 0, 0, 1 },
+   { "diffuse_color", offsetof(obj, diffuse_color), 3, 0, 0, 0, 2 },
+   { "specular_color", offsetof(obj, specular_color), 3, 0, 0, 0, 3 },
+   { "radius", offsetof(obj, radius), 1, FIELD_MIN, 0, 0, 4 },
+   { "reflectivity", offsetof(obj, reflectivity), 1, FIELD_MIN | FIELD_MAX, 0, 1, 5 },
+   { "refractivity", offsetof(obj, refractivity), 1, FIELD_MIN | FIELD_MAX, 0, 1, 5 },
+   { "ior", offsetof(obj, ior), 1, FIELD_MIN, 0, 0, 5 }
+};
+static const int sphere_groups[] =
+{
+   GROUP_ALL_OR_NONE, GROUP_REQUIRED, GROUP_REQUIRED, GROUP_REQUIRED, GROUP_REQUIRED, GROUP_ALL_OR_NONE
+};
+
+// Plane properties; color, specular color and the reflect/refract/ior trio are optional
+static const field_spec plane_fields[] =
+{
+   { "color", offsetof(obj, color), 3, FIELD_MIN | FIELD_MAX | FIELD_STRICT, 0, 1, 0 },
+   { "position", offsetof(obj, position), 3, 0, 0, 0, 1 },
+   { "normal", offsetof(obj, normal), 3, 0, 0, 0, 2 },
+   { "diffuse_color", offsetof(obj, diffuse_color), 3, 0, 0, 0, 3 },
+   { "specular_color", offsetof(obj, specular_color), 3, 0, 0, 0, 4 },
+   { "reflectivity", offsetof(obj, reflectivity), 1, FIELD_MIN | FIELD_MAX, 0, 1, 5 },
+   { "refractivity", offsetof(obj, refractivity), 1, FIELD_MIN | FIELD_MAX, 0, 1, 5 },
+   { "ior", offsetof(obj, ior), 1, FIELD_MIN, 0, 0, 5 }
+};
+static const int plane_groups[] =
+{
+   GROUP_ALL_OR_NONE, GROUP_REQUIRED, GROUP_REQUIRED, GROUP_REQUIRED, GROUP_ALL_OR_NONE, GROUP_ALL_OR_NONE
+};
+
+// Light properties; direction and angular falloff are checked by check_light
+static const field_spec light_fields[] =
+{
+   { "color", offsetof(obj, color), 3, FIELD_MIN | FIELD_STRICT, 0, 0, 0 },
+   { "position", offsetof(obj, position), 3, 0, 0, 0, 1 },
+   { "direction", offsetof(obj, direction), 3, 0, 0, 0, LIGHT_SPOT_GROUP },
+   { "theta", offsetof(obj, theta), 1, 0, 0, 0, LIGHT_THETA_GROUP },
+   { "radial-a0", offsetof(obj, radial_a0), 1, FIELD_MIN | FIELD_MAX | FIELD_STRICT, 0, 1, 2 },
+   { "radial-a1", offsetof(obj, radial_a1), 1, FIELD_MIN | FIELD_MAX | FIELD_STRICT, 0, 1, 2 },
+   { "radial-a2", offsetof(obj, radial_a2), 1, FIELD_MIN | FIELD_MAX | FIELD_STRICT, 0, 1, 2 },
+   { "angular-a0", offsetof(obj, angular_a0), 1, FIELD_MIN | FIELD_MAX | FIELD_STRICT, 0, 1, LIGHT_SPOT_GROUP }
+};
+static const int light_groups[] =
+{
+   GROUP_REQUIRED, GROUP_REQUIRED, GROUP_REQUIRED, GROUP_ALL_OR_NONE, GROUP_CUSTOM
+};
+
+// Every object type the parser knows, in the order they are matched
+static const object_schema schemas[] =
+{
+   { "camera", CAMERA, camera_fields, sizeof(camera_fields) / sizeof(field_spec),
+     camera_groups, sizeof(camera_groups) / sizeof(int), CAM_VAL_COUNT, NULL },
+   { "sphere", SPHERE, sphere_fields, sizeof(sphere_fields) / sizeof(field_spec),
+     sphere_groups, sizeof(sphere_groups) / sizeof(int), SPHERE_VAL_COUNT, NULL },
+   { "plane", PLANE, plane_fields, sizeof(plane_fields) / sizeof(field_spec),
+     plane_groups, sizeof(plane_groups) / sizeof(int), PLANE_VAL_COUNT, NULL },
+   { "light", LIGHT, light_fields, sizeof(light_fields) / sizeof(field_spec),
+     light_groups, sizeof(light_groups) / sizeof(int), LIGHT_VAL_COUNT, check_light }
+};
+
+// Hashed lookup of (object type, property name) and the found bits of each
+// validation group, filled on first use
+static field_slot field_slots[PROPERTY_SLOTS];
+static unsigned int group_masks[SCHEMA_COUNT][MAX_GROUPS];
+static bool field_table_built = FALSE;
+
+// Powers of ten that are exact in a double
+static const double exact_pow10[] =
+{
+   1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Helper function used to return the next character of the input, or EOF at the end
+static inline char next_char(source *src)
+{
+   return src->cur < src->end ? *src->cur++ : EOF;
+}
+
+// Helper function used to compare a word against a string. Lengths are compared
+// first, which the compiler can fold for string literals.
+static inline bool token_is(token *word, const char *text)
+{
+   return word->len == (int)strlen(text) && memcmp(word->start, text, word->len) == 0;
+}
+
+// Helper function used to detect white-space without a locale lookup
+static inline bool is_blank(char c)
+{
+   return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
 
 // Method used to parse out objects in the input file
 void parse(linked_list *list, char *file_name, int *result)
 {
    // Variable declarations
-   FILE *file;
+   int file;
+   struct stat info;
+   char *data;
+   source src;
    char c;
    obj cur_obj;
 
    // Start by attemping to open the file
-   file = fopen(file_name, "r");
+   file = open(file_name, O_RDONLY);
 
-   // Check if file exists
-   if (file)
+   // Check if file exists and can be mapped
+   if (file < 0 || fstat(file, &info) != 0)
    {
-      // Read file character by character until file ends
-      while ((c = fgetc(file)) != EOF)
+      *result = INPUT_INVALID;
+      if (file >= 0)
       {
-         // Store object properties
-         store_obj_properties(&cur_obj, file, &c, result);
-
-         // Confirm that store operation worked correctly
-         if (*result == RUN_SUCCESS)
-         {
-            // Create node and append to list
-            create_node(&cur_obj, list);
-
-            // If the current node is a camera, set the main camera value
-            if (cur_obj.type == CAMERA)
-            {
-               list->main_camera = list->last;
-            }
-         }
-
-         // If not, execution halts
+         close(file);
       }
-
-      // Close file
-      fclose(file);
+      return;
    }
-   // If not, return error code
-   else
+
+   // Map the whole file so it can be tokenized in place
+   data = info.st_size > 0 ? mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, file, 0) : NULL;
+   close(file);
+   if (data == MAP_FAILED)
    {
       *result = INPUT_INVALID;
+      return;
    }
-}
+   src.cur = data;
+   src.end = data + info.st_size;
 
-// Helper method used to store object properties 
-void store_obj_properties(obj *cur_obj, FILE *file, char *c, int *result)
-{
-   // Variable declarations
-   char obj_type[TYPE_LEN];
+   // Each object checks the result of the one before it
+   *result = RUN_SUCCESS;
 
-   // Start by retrieving object type
-   get_next_word(obj_type, VALUE_SEP, TYPE_LEN, file, c);
+   // Start with every property cleared
+   memset(&cur_obj, 0, sizeof(obj));
 
-   // Store data based on object type
-   if (strcmp(obj_type, "camera") == 0)
+   // Build the property lookup table once
+   if (field_table_built == FALSE)
    {
-      // Store object type
-      cur_obj->type = CAMERA;
-
-      // Store object properties
-      get_camera(cur_obj, file, c, result);
+      build_field_table();
    }
-   else if (strcmp(obj_type, "sphere") == 0)
-   {
-      // Store object type
-      cur_obj->type = SPHERE;
 
-      // Store object variables
-      get_sphere(cur_obj, file, c, result);
-   }
-   else if (strcmp(obj_type, "plane") == 0)
+   // Read file character by character until file ends
+   while ((c = next_char(&src)) != EOF)
    {
-      // Store object type
-      cur_obj->type = PLANE;
+      // Store object properties
+      store_obj_properties(&cur_obj, &src, &c, result);
+
+      // Confirm that store operation worked correctly
+      if (*result == RUN_SUCCESS)
+      {
+         // Create node and append to list
+         create_node(&cur_obj, list);
+
+         // If the current node is a camera, set the main camera value
+         if (cur_obj.type == CAMERA)
+         {
+            list->main_camera = list->last;
+         }
+      }
 
-      // Store object variables
-      get_plane(cur_obj, file, c, result);
+      // If not, execution halts
    }
-   else if (strcmp(obj_type, "light") == 0)
-   {
-      // Store object type
-      cur_obj->type = LIGHT;
 
-      // Store object variables
-      get_light(cur_obj, file, c, result);
+   // Unmap file
+   if (data != NULL)
+   {
+      munmap(data, info.st_size);
    }
-   else
+
+   // An empty file holds no objects
+   if (list->size == 0)
    {
       *result = INPUT_INVALID;
-   }   
+   }
 }
 
-// Helper method used to store camera object variables
-void get_camera(obj *cur_obj, FILE *file, char *c, int *result)
+// Helper method used to store object properties 
+void store_obj_properties(obj *cur_obj, source *src, char *c, int *result)
 {
    // Variable declarations
-   char property[PROPERTY_LEN];
-   char value[VALUE_LEN];
-   bool width_found = FALSE;
-   bool height_found = FALSE;
-   int prop_count = 0;
+   token obj_type;
+   int index;
 
-   // Store object type
-   cur_obj->type = CAMERA;
+   // Start by retrieving object type
+   get_next_token(&obj_type, VALUE_SEP, src, c);
 
-   // Store object variables
-   while (*c != LINE_TERM && *c != EOF)
+   // Store data based on object type
+   for (index = 0; index < SCHEMA_COUNT; index++)
    {
-      // Get next word in line
-      get_next_word(property, PROP_SEP, PROPERTY_LEN, file, c);
-
-      // Compare property value
-      if (strcmp(property, "width") == 0)
-      {
-         // Get property value
-         get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-         // Set property value
-         cur_obj->width = atof(value);
-
-         // Set boolean value
-         width_found = TRUE;
-
-         // Increment the prop count
-         prop_count++;
-      }
-      else if (strcmp(property, "height") == 0)
+      if (token_is(&obj_type, schemas[index].name))
       {
-         // Get property value
-         get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
+         // Store object type
+         cur_obj->type = schemas[index].type;
 
-         // Set property value
-         cur_obj->height = atof(value);
-
-         // Set boolean value
-         height_found = TRUE;
-
-         // Increment the prop count
-         prop_count++;
-      }
-      else
-      {
-         *result = INPUT_INVALID;
+         // Store object variables
+         get_properties(cur_obj, &schemas[index], src, c, result);
+         return;
       }
-
-      // Clear values
-      property[0] = STR_END;
-      value[0] = STR_END;
    }
 
-   // Return error code if height or width was not found
-   if (width_found == TRUE && height_found == TRUE && *result != INPUT_INVALID && prop_count <= CAM_VAL_COUNT)
-   {
-      *result = RUN_SUCCESS;
-   }
-   else
-   {
-      *result = INPUT_INVALID;
-   }
+   // Unknown object type
+   *result = INPUT_INVALID;
 }
 
-// Helper method used to store sphere object variables
-void get_sphere(obj *cur_obj, FILE *file, char *c, int *result)
+// Helper method used to store every property on the rest of the line for any object type
+void get_properties(obj *cur_obj, const object_schema *schema, source *src, char *c, int *result)
 {
    // Variable declarations
-   char property[PROPERTY_LEN];
-   char value[VALUE_LEN];
-
-   bool r_found = FALSE;
-   bool g_found = FALSE;
-   bool b_found = FALSE;
-
-   bool x_found = FALSE;
-   bool y_found = FALSE;
-   bool z_found = FALSE;
-
-   bool sr_found = FALSE;
-   bool sg_found = FALSE;
-   bool sb_found = FALSE;
-
-   bool dr_found = FALSE;
-   bool dg_found = FALSE;
-   bool db_found = FALSE;
-   
-   bool reflect_found = FALSE;
-   bool refract_found = FALSE;
-   bool ior_found = FALSE;
-
-   bool radius_found = FALSE;
+   token property;
+   const field_slot *slot;
+   unsigned int found = 0;
    int prop_count = 0;
 
    // Store object variables
    while (*c != LINE_TERM && *c != EOF)
    {
       // Get next word in line
-      get_next_word(property, PROP_SEP, PROPERTY_LEN, file, c);
-
-      // Compare property value
-      if (strcmp(property, "color") == 0)
-      {
-         // Since value is property, get everything up to "["
-         while (*c != LINE_TERM && isspace(*c))
-         {
-            *c = fgetc(file);
-         }
-
-         // Get the r color value
-         if (*c != EOF && *c == V3_START && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Make sure r is between 0 and 1
-            if (atof(value) <= 1 && atof(value) >= 0)
-            {
-               // Set property value
-               cur_obj->color.r = atof(value);
-
-               // Set boolean value
-               r_found = TRUE;
-            }
-         }
-
-         // Get the g color value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Make sure g is between 0 and 1
-            if (atof(value) <= 1 && atof(value) >= 0)
-            {
-               // Set property value
-               cur_obj->color.g = atof(value);
-
-               // Set boolean value
-               g_found = TRUE;
-            }
-         }
-
-         // Get the b color value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, V3_END, VALUE_LEN, file, c);
-
-            // Make sure b is between 0 and 1
-            if (atof(value) <= 1 && atof(value) >= 0)
-            {
-               // Set property value
-               cur_obj->color.b = atof(value);
-
-               // Set boolean value
-               b_found = TRUE;
-            }
-         }
-
-         // Make sure if ',' is next character, it moves past it
-         if (*c == VALUE_SEP && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-         }
-
-         // Increment property count if all found
-         prop_count++;
-      }
-      else if (strcmp(property, "position") == 0)
-      {
-         // Since value is property, get everything up to "["
-         while (*c != LINE_TERM && isspace(*c))
-         {
-            *c = fgetc(file);
-         }
-
-         // Get the x value
-         if (*c != EOF && *c == V3_START && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->position.x = atof(value);
-
-            // Set boolean value
-            x_found = TRUE;
-         }
-
-         // Get the y value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->position.y = atof(value);
-
-            // Set boolean value
-            y_found = TRUE;
-         }
-
-         // Get the z value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, V3_END, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->position.z = atof(value);
-
-            // Set boolean value
-            z_found = TRUE;
-         }
-
-         // Make sure that if ',' is next character, it moves past it
-         if (*c == VALUE_SEP && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-         }
-
-         // Increment property count if all found
-         prop_count++;
-      }
-      else if (strcmp(property, "diffuse_color") == 0)
-      {
-         // Since value is property, get everything up to "["
-         while (*c != LINE_TERM && isspace(*c))
-         {
-            *c = fgetc(file);
-         }
-
-         // Get the dr value
-         if (*c != EOF && *c == V3_START && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->diffuse_color.r = atof(value);
-
-            // Set boolean value
-            dr_found = TRUE;
-         }
-
-         // Get the dg value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->diffuse_color.g = atof(value);
-
-            // Set boolean value
-            dg_found = TRUE;
-         }
-
-         // Get the db value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, V3_END, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->diffuse_color.b = atof(value);
-
-            // Set boolean value
-            db_found = TRUE;
-         }
-
-         // Make sure that if ',' is next character, it moves past it
-         if (*c == VALUE_SEP && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-         }
-
-         // Increment property count if all found
-         prop_count++;
-      }
-      else if (strcmp(property, "specular_color") == 0)
-      {
-         // Since value is property, get everything up to "["
-         while (*c != LINE_TERM && isspace(*c))
-         {
-            *c = fgetc(file);
-         }
-
-         // Get the sr value
-         if (*c != EOF && *c == V3_START && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->specular_color.r = atof(value);
-
-            // Set boolean value
-            sr_found = TRUE;
-         }
-
-         // Get the sg value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->specular_color.g = atof(value);
-
-            // Set boolean value
-            sg_found = TRUE;
-         }
-
-         // Get the sb value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, V3_END, VALUE_LEN, file, c);
+      get_next_token(&property, PROP_SEP, src, c);
 
-            // Set property value
-            cur_obj->specular_color.b = atof(value);
+      // Look the property up for this object type
+      slot = find_field(schema, &property);
 
-            // Set boolean value
-            sb_found = TRUE;
-         }
-
-         // Make sure that if ',' is next character, it moves past it
-         if (*c == VALUE_SEP && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-         }
-
-         // Increment property count if all found
-         prop_count++;
-      }
-      else if (strcmp(property, "radius") == 0)
-      {
-         // Get property value
-         get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-         // Set property value
-         cur_obj->radius = atof(value);
-
-         // Make sure radius is greater than 0
-         if (atof(value) >= 0)
-         {
-            // Set boolean value
-            radius_found = TRUE;
-         }
-
-         // Increment the prop count
-         prop_count++;
-      }
-      else if (strcmp(property, "reflectivity") == 0)
-      {
-         // Get property value
-         get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-         // Set property value
-         cur_obj->reflectivity = atof(value);
-
-         // Make sure radius is between 0 and 1
-         if (atof(value) >= 0 && atof(value) <= 1)
-         {
-            // Set boolean value
-            reflect_found = TRUE;
-         }
-
-         // Increment the prop count
-         prop_count++;
-      }
-      else if (strcmp(property, "refractivity") == 0)
+      // Store property value, counting it unless the schema rejected it
+      if (slot == NULL)
       {
-         // Get property value
-         get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-         // Set property value
-         cur_obj->refractivity = atof(value);
-
-         // Make sure radius is between 0 and 1
-         if (atof(value) >= 0 && atof(value) <= 1)
-         {
-            // Set boolean value
-            refract_found = TRUE;
-         }
-
-         // Increment the prop count
-         prop_count++;
+         *result = INPUT_INVALID;
       }
-      else if (strcmp(property, "ior") == 0)
+      else if (read_field(cur_obj, slot, src, c, &found) == TRUE)
       {
-         // Get property value
-         get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-         // Set property value
-         cur_obj->ior = atof(value);
-
-         // Make sure radius is greater than 0
-         if (atof(value) >= 0)
-         {
-            // Set boolean value
-            ior_found = TRUE;
-         }
-
-         // Increment the prop count
          prop_count++;
       }
-      else
-      {
-         *result = INPUT_INVALID;
-      }
-
-      // Clear values
-      property[0] = STR_END;
-      value[0] = STR_END;
    }
 
    // Return error code if required values are not found
-   if (((r_found == TRUE && g_found == TRUE && b_found == TRUE) ||
-       (r_found == FALSE && g_found == FALSE && b_found == FALSE)) &&
-       x_found == TRUE && y_found == TRUE && z_found == TRUE &&
-       dr_found == TRUE && dg_found == TRUE && db_found == TRUE &&
-       sr_found == TRUE && sg_found == TRUE && sb_found == TRUE &&
-       ((reflect_found == TRUE && refract_found == TRUE && ior_found == TRUE) ||
-        (reflect_found == FALSE && refract_found == FALSE && ior_found == FALSE)) &&
-       radius_found == TRUE && *result != INPUT_INVALID && prop_count <= SPHERE_VAL_COUNT)
+   if (*result != INPUT_INVALID && prop_count <= schema->max_props && check_groups(cur_obj, schema, found) == TRUE)
    {
       *result = RUN_SUCCESS;
    }
@@ -575,827 +281,377 @@ void get_sphere(obj *cur_obj, FILE *file, char *c, int *result)
    }
 }
 
-// Helper method used to store plane object variables
-void get_plane(obj *cur_obj, FILE *file, char *c, int *result)
+// Helper method used to read a single value or a [x, y, z] vector into its fields.
+// Returns whether the property counts towards the object's property limit.
+bool read_field(obj *cur_obj, const field_slot *slot, source *src, char *c, unsigned int *found)
 {
    // Variable declarations
-   char property[PROPERTY_LEN];
-   char value[VALUE_LEN];
-
-   bool r_found = FALSE;
-   bool g_found = FALSE;
-   bool b_found = FALSE;
-
-   bool x_found = FALSE;
-   bool y_found = FALSE;
-   bool z_found = FALSE;
-
-   bool n1_found = FALSE;
-   bool n2_found = FALSE;
-   bool n3_found = FALSE;
-
-   bool sr_found = FALSE;
-   bool sg_found = FALSE;
-   bool sb_found = FALSE;
-
-   bool dr_found = FALSE;
-   bool dg_found = FALSE;
-   bool db_found = FALSE;
-   
-   bool reflect_found = FALSE;
-   bool refract_found = FALSE;
-   bool ior_found = FALSE;
-
-   int prop_count = 0;
-
-   // Store object variables
-   while (*c != LINE_TERM && *c != EOF)
+   const field_spec *field = slot->field;
+   float *target = (float *)((char *)cur_obj + field->offset);
+   double value = 0;
+   bool valid;
+   int index;
+
+   // Single values follow the separator directly
+   if (field->arity == 1)
    {
-      // Get next word in line
-      get_next_word(property, PROP_SEP, PROPERTY_LEN, file, c);
+      // Get property value
+      get_next_value(&value, VALUE_SEP, src, c);
 
-      // Compare property value
-      if (strcmp(property, "color") == 0)
+      // Set property value and mark it found if it was in range
+      valid = store_value(target, field, value);
+      if (valid == TRUE)
       {
-         // Since value is property, get everything up to "["
-         while (*c != LINE_TERM && isspace(*c))
-         {
-            *c = fgetc(file);
-         }
-
-         // Get the r color value
-         if (*c != EOF && *c == V3_START && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Make sure r is between 0 and 1
-            if (atof(value) <= 1 && atof(value) >= 0)
-            {
-               // Set property value
-               cur_obj->color.r = atof(value);
-
-               // Set boolean value
-               r_found = TRUE;
-            }
-         }
-
-         // Get the g color value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Make sure g is between 0 and 1
-            if (atof(value) <= 1 && atof(value) >= 0)
-            {
-               // Set property value
-               cur_obj->color.g = atof(value);
-
-               // Set boolean value
-               g_found = TRUE;
-            }
-         }
-
-         // Get the b color value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, V3_END, VALUE_LEN, file, c);
-
-            // Make sure b is between 0 and 1
-            if (atof(value) <= 1 && atof(value) >= 0)
-            {
-               // Set property value
-               cur_obj->color.b = atof(value);
-
-               // Set boolean value
-               b_found = TRUE;
-            }
-         }
-
-         // Make sure if ',' is next character, it moves past it
-         if (*c == VALUE_SEP && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-         }
-
-         // Increment property count if all found
-         prop_count++;
+         *found |= 1u << slot->first_bit;
       }
-      else if (strcmp(property, "position") == 0)
-      {
-         // Since value is property, get everything up to "["
-         while (*c != LINE_TERM && isspace(*c))
-         {
-            *c = fgetc(file);
-         }
 
-         // Get the x value
-         if (*c != EOF && *c == V3_START && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->position.x = atof(value);
-
-            // Set boolean value
-            x_found = TRUE;
-         }
+      // Values that are only stored when in range are only counted then too
+      return valid == TRUE || (field->flags & FIELD_STRICT) == 0;
+   }
 
-         // Get the y value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
+   // Since value is property, get everything up to "["
+   while (*c != LINE_TERM && is_blank(*c))
+   {
+      *c = next_char(src);
+   }
 
-            // Set property value
-            cur_obj->position.y = atof(value);
+   // Get each component; the first one must open the vector
+   for (index = 0; index < field->arity; index++)
+   {
+      if (*c != EOF && *c != LINE_TERM && (index > 0 || *c == V3_START))
+      {
+         *c = next_char(src);
 
-            // Set boolean value
-            y_found = TRUE;
-         }
+         // Get property value, the last one ends the vector
+         get_next_value(&value, index == field->arity - 1 ? V3_END : VALUE_SEP, src, c);
 
-         // Get the z value
-         if (*c != EOF && *c != LINE_TERM)
+         // Set property value and mark it found if it was in range
+         if (store_value(target + index, field, value) == TRUE)
          {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, V3_END, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->position.z = atof(value);
-
-            // Set boolean value
-            z_found = TRUE;
+            *found |= 1u << (slot->first_bit + index);
          }
-
-         // Make sure that if ',' is next character, it moves past it
-         if (*c == VALUE_SEP && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-         }
-
-         // Increment property count if all found
-         prop_count++;
       }
-      else if (strcmp(property, "diffuse_color") == 0)
-      {
-         // Since value is property, get everything up to "["
-         while (*c != LINE_TERM && isspace(*c))
-         {
-            *c = fgetc(file);
-         }
-
-         // Get the dr value
-         if (*c != EOF && *c == V3_START && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->diffuse_color.r = atof(value);
-
-            // Set boolean value
-            dr_found = TRUE;
-         }
-
-         // Get the dg value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
+   }
 
-            // Set property value
-            cur_obj->diffuse_color.g = atof(value);
+   // Make sure that if ',' is next character, it moves past it
+   if (*c == VALUE_SEP)
+   {
+      *c = next_char(src);
+   }
 
-            // Set boolean value
-            dg_found = TRUE;
-         }
+   // Vectors count even when a component is missing
+   return TRUE;
+}
 
-         // Get the db value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, V3_END, VALUE_LEN, file, c);
+// Helper method used to store a value unless the field only keeps values in range.
+// Returns whether the value was in range.
+bool store_value(float *target, const field_spec *field, double value)
+{
+   // Variable declarations
+   bool valid = ((field->flags & FIELD_MIN) == 0 || value >= field->min) &&
+                ((field->flags & FIELD_MAX) == 0 || value <= field->max);
 
-            // Set property value
-            cur_obj->diffuse_color.b = atof(value);
+   // Set property value
+   if (valid == TRUE || (field->flags & FIELD_STRICT) == 0)
+   {
+      *target = value;
+   }
 
-            // Set boolean value
-            db_found = TRUE;
-         }
+   return valid;
+}
 
-         // Make sure that if ',' is next character, it moves past it
-         if (*c == VALUE_SEP && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-         }
+// Helper method used to check the found values of each validation group
+bool check_groups(obj *cur_obj, const object_schema *schema, unsigned int found)
+{
+   // Variable declarations
+   const unsigned int *masks = group_masks[schema - schemas];
+   unsigned int bits;
+   int index;
 
-         // Increment property count if all found
-         prop_count++;
-      }
-      else if (strcmp(property, "specular_color") == 0)
+   // Required groups need every value, the others all or none of them
+   for (index = 0; index < schema->group_count; index++)
+   {
+      bits = found & masks[index];
+      if ((schema->group_rules[index] == GROUP_REQUIRED && bits != masks[index]) ||
+          (schema->group_rules[index] == GROUP_ALL_OR_NONE && bits != 0 && bits != masks[index]))
       {
-         // Since value is property, get everything up to "["
-         while (*c != LINE_TERM && isspace(*c))
-         {
-            *c = fgetc(file);
-         }
-
-         // Get the sr value
-         if (*c != EOF && *c == V3_START && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->specular_color.r = atof(value);
+         return FALSE;
+      }
+   }
 
-            // Set boolean value
-            sr_found = TRUE;
-         }
+   // Leave anything else to the object type
+   return schema->check == NULL || schema->check(cur_obj, found, masks) == TRUE;
+}
 
-         // Get the sg value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
+// Helper method used to check that a light with a non-zero theta has every spot light
+// property and that any other light has none of them
+bool check_light(obj *cur_obj, unsigned int found, const unsigned int *masks)
+{
+   // Variable declarations
+   unsigned int spot = found & masks[LIGHT_SPOT_GROUP];
 
-            // Set property value
-            cur_obj->specular_color.g = atof(value);
+   // Spot lights need direction and angular falloff
+   if ((found & masks[LIGHT_THETA_GROUP]) != 0 && cur_obj->theta != 0)
+   {
+      return spot == masks[LIGHT_SPOT_GROUP];
+   }
 
-            // Set boolean value
-            sg_found = TRUE;
-         }
+   return spot == 0;
+}
 
-         // Get the sb value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, V3_END, VALUE_LEN, file, c);
+// Helper method used to hash a property name together with its object type. Only the
+// length and three characters are mixed in, which is enough to spread the known names.
+unsigned int hash_key(int type, const char *text, int len)
+{
+   // Variable declarations
+   unsigned int hash = (unsigned int)type * 97u + (unsigned int)len * 31u;
 
-            // Set property value
-            cur_obj->specular_color.b = atof(value);
+   // Empty names all share one slot
+   if (len > 0)
+   {
+      hash += (unsigned char)text[0] * 7u + (unsigned char)text[len / 2] * 3u + (unsigned char)text[len - 1];
+   }
 
-            // Set boolean value
-            sb_found = TRUE;
-         }
+   return hash & (PROPERTY_SLOTS - 1);
+}
 
-         // Make sure that if ',' is next character, it moves past it
-         if (*c == VALUE_SEP && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-         }
+// Helper method used to fill the property lookup table from the schemas
+void build_field_table()
+{
+   // Variable declarations
+   int index;
+   int field;
+   int first_bit;
+   unsigned int slot;
 
-         // Increment property count if all found
-         prop_count++;
-      }
-      else if (strcmp(property, "normal") == 0)
+   // Insert every field with linear probing
+   for (index = 0; index < SCHEMA_COUNT; index++)
+   {
+      first_bit = 0;
+      for (field = 0; field < schemas[index].field_count; field++)
       {
-         // Since value is property, get everything up to "["
-         while (*c != LINE_TERM && isspace(*c))
+         slot = hash_key(schemas[index].type, schemas[index].fields[field].name,
+                         strlen(schemas[index].fields[field].name));
+         while (field_slots[slot].field != NULL)
          {
-            *c = fgetc(file);
+            slot = (slot + 1) & (PROPERTY_SLOTS - 1);
          }
 
-         // Get the normal x value
-         if (*c != EOF && *c == V3_START && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->normal.x = atof(value);
-
-            // Set boolean value
-            n1_found = TRUE;
-         }
-
-         // Get the normal y value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->normal.y = atof(value);
-
-            // Set boolean value
-            n2_found = TRUE;
-         }
-
-         // Get the normal z value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, V3_END, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->normal.z = atof(value);
+         field_slots[slot].schema = &schemas[index];
+         field_slots[slot].field = &schemas[index].fields[field];
+         field_slots[slot].name_len = strlen(schemas[index].fields[field].name);
+         field_slots[slot].first_bit = first_bit;
 
-            // Set boolean value
-            n3_found = TRUE;
-         }
-
-         // Make sure that if ',' is next character, it moves past it
-         if (*c == VALUE_SEP)
-         {
-            *c = fgetc(file);
-         }
-
-         // Increment property count if all found
-         prop_count++;
+         // Collect the bits of the field's values in its group
+         group_masks[index][schemas[index].fields[field].group] |=
+            ((1u << schemas[index].fields[field].arity) - 1) << first_bit;
+         first_bit += schemas[index].fields[field].arity;
       }
-      else if (strcmp(property, "reflectivity") == 0)
-      {
-         // Get property value
-         get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
+   }
 
-         // Set property value
-         cur_obj->reflectivity = atof(value);
+   field_table_built = TRUE;
+}
 
-         // Make sure radius is between 0 and 1
-         if (atof(value) >= 0 && atof(value) <= 1)
-         {
-            // Set boolean value
-            reflect_found = TRUE;
-         }
+// Helper method used to find a property of an object type, or NULL if it has none by that name
+const field_slot *find_field(const object_schema *schema, token *property)
+{
+   // Variable declarations
+   unsigned int slot = hash_key(schema->type, property->start, property->len);
 
-         // Increment the prop count
-         prop_count++;
-      }
-      else if (strcmp(property, "refractivity") == 0)
+   // Probe until the name is found or an empty slot ends the search
+   while (field_slots[slot].field != NULL)
+   {
+      if (field_slots[slot].schema == schema && field_slots[slot].name_len == property->len &&
+          memcmp(property->start, field_slots[slot].field->name, property->len) == 0)
       {
-         // Get property value
-         get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-         // Set property value
-         cur_obj->refractivity = atof(value);
-
-         // Make sure radius is between 0 and 1
-         if (atof(value) >= 0 && atof(value) <= 1)
-         {
-            // Set boolean value
-            refract_found = TRUE;
-         }
-
-         // Increment the prop count
-         prop_count++;
+         return &field_slots[slot];
       }
-      else if (strcmp(property, "ior") == 0)
-      {
-         // Get property value
-         get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
+      slot = (slot + 1) & (PROPERTY_SLOTS - 1);
+   }
 
-         // Set property value
-         cur_obj->ior = atof(value);
+   return NULL;
+}
 
-         // Make sure radius is greater than 0
-         if (atof(value) >= 0)
-         {
-            // Set boolean value
-            ior_found = TRUE;
-         }
+// Helper method used to retrieve the next word without copying it
+void get_next_token(token *word, char delim, source *src, char *c)
+{
+   // Variable declarations
+   const char *cur;
 
-         // Increment the prop count
-         prop_count++;
-      }
-      else
-      {
-         *result = INPUT_INVALID;
-      }
+   // Start by stripping white-space from front of word
+   while (is_blank(*c))
+   {
+      *c = next_char(src);
+   }
 
-      // Clear values
-      property[0] = STR_END;
-      value[0] = STR_END;
+   // The current character has already been read, so the word starts behind the cursor
+   word->start = src->cur - 1;
+   word->len = 0;
+   if (*c == EOF)
+   {
+      return;
    }
 
-   // Return error code if required values are not found
-   if (((r_found == TRUE && g_found == TRUE && b_found == TRUE) ||
-       (r_found == FALSE && g_found == FALSE && b_found == FALSE)) &&
-       x_found == TRUE && y_found == TRUE && z_found == TRUE &&
-       n1_found == TRUE && n2_found == TRUE && n3_found == TRUE &&
-       dr_found == TRUE && dg_found == TRUE && db_found == TRUE &&
-       ((sr_found == TRUE && sg_found == TRUE && sb_found == TRUE) ||
-       (sr_found == FALSE && sg_found == FALSE && sb_found == FALSE)) &&
-       ((reflect_found == TRUE && refract_found == TRUE && ior_found == TRUE) ||
-        (reflect_found == FALSE && refract_found == FALSE && ior_found == FALSE)) &&
-       *result != INPUT_INVALID && prop_count <= SPHERE_VAL_COUNT)
+   // While deliminator is not reached, scan the mapped bytes directly
+   cur = word->start;
+   while (cur < src->end && *cur != delim && *cur != LINE_TERM)
    {
-      *result = RUN_SUCCESS;
+      cur++;
+   }
+   word->len = cur - word->start;
+
+   // Update the cursor and current character
+   finish_token(cur, src, c);
+}
+
+// Helper method used to stop at the end of the file or line, otherwise move past the deliminator
+void finish_token(const char *cur, source *src, char *c)
+{
+   if (cur >= src->end)
+   {
+      src->cur = src->end;
+      *c = EOF;
    }
    else
    {
-      *result = INPUT_INVALID;
+      src->cur = cur + 1;
+      *c = *cur == LINE_TERM ? LINE_TERM : next_char(src);
    }
 }
 
-
-// Helper method used to store light object variables
-void get_light(obj *cur_obj, FILE *file, char *c, int *result)
+// Helper method used to retrieve the next word and convert it to a number in the same pass
+void get_next_value(double *value, char delim, source *src, char *c)
 {
    // Variable declarations
-   char property[PROPERTY_LEN];
-   char value[VALUE_LEN];
+   const char *cur;
 
-   bool r_found = FALSE;
-   bool g_found = FALSE;
-   bool b_found = FALSE;
+   // Start by stripping white-space from front of word
+   while (is_blank(*c))
+   {
+      *c = next_char(src);
+   }
 
-   bool x_found = FALSE;
-   bool y_found = FALSE;
-   bool z_found = FALSE;
+   // Nothing left to read
+   if (*c == EOF)
+   {
+      *value = 0;
+      return;
+   }
 
-   bool dx_found = FALSE;
-   bool dy_found = FALSE;
-   bool dz_found = FALSE;
+   // Convert the number where it lies; it always stops before the deliminator
+   *value = parse_number(src->cur - 1, src->end, &cur);
 
-   bool theta_found = FALSE;
-   bool radial_a0_found = FALSE;
-   bool radial_a1_found = FALSE;
-   bool radial_a2_found = FALSE;
-   bool angular_a0_found = FALSE;
+   // Skip anything after the number, just like atof ignores it
+   while (cur < src->end && *cur != delim && *cur != LINE_TERM)
+   {
+      cur++;
+   }
 
-   int prop_count = 0;
+   // Update the cursor and current character
+   finish_token(cur, src, c);
+}
 
-   // Store object variables
-   while (*c != LINE_TERM && *c != EOF)
+// Helper method used to convert a decimal number, ignoring trailing characters like atof.
+// Numbers with up to 15 significant digits and small exponents are converted exactly
+// with one multiply or divide; anything else falls back to strtod. On return stop
+// points just past the characters that were used.
+double parse_number(const char *start, const char *end, const char **stop)
+{
+   // Variable declarations
+   const char *cur = start;
+   unsigned long long mantissa = 0;
+   int digits = 0;
+   int exponent = 0;
+   bool negative = FALSE;
+   bool any_digits = FALSE;
+   char copy[VALUE_LEN];
+   int len;
+
+   // Read sign
+   if (cur < end && (*cur == '-' || *cur == '+'))
    {
-      // Get next word in line
-      get_next_word(property, PROP_SEP, PROPERTY_LEN, file, c);
+      negative = *cur == '-';
+      cur++;
+   }
 
-      // Compare property value
-      if (strcmp(property, "color") == 0)
+   // Read integer digits, skipping leading zeros
+   while (cur < end && *cur >= '0' && *cur <= '9')
+   {
+      if (mantissa != 0 || *cur != '0')
       {
-         // Since value is property, get everything up to "["
-         while (*c != LINE_TERM && isspace(*c))
-         {
-            *c = fgetc(file);
-         }
-
-         // Get the r color value
-         if (*c != EOF && *c == V3_START && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Make sure r is greater than 0
-            if (atof(value) >= 0)
-            {
-               // Set property value
-               cur_obj->color.r = atof(value);
-
-               // Set boolean value
-               r_found = TRUE;
-            }
-         }
-
-         // Get the g color value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Make sure g is greater than 0
-            if (atof(value) >= 0)
-            {
-               // Set property value
-               cur_obj->color.g = atof(value);
-
-               // Set boolean value
-               g_found = TRUE;
-            }
-         }
-
-         // Get the b color value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, V3_END, VALUE_LEN, file, c);
-
-            // Make sure b is greater than 0
-            if (atof(value) >= 0)
-            {
-               // Set property value
-               cur_obj->color.b = atof(value);
-
-               // Set boolean value
-               b_found = TRUE;
-            }
-         }
-
-         // Make sure if ',' is next character, it moves past it
-         if (*c == VALUE_SEP && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-         }
-
-         // Increment property count if all found
-         prop_count++;
+         mantissa = mantissa * 10 + (*cur - '0');
+         digits++;
       }
-      else if (strcmp(property, "position") == 0)
-      {
-         // Since value is property, get everything up to "["
-         while (*c != LINE_TERM && isspace(*c))
-         {
-            *c = fgetc(file);
-         }
-
-         // Get the x value
-         if (*c != EOF && *c == V3_START && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->position.x = atof(value);
-
-            // Set boolean value
-            x_found = TRUE;
-         }
-
-         // Get the y value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->position.y = atof(value);
-
-            // Set boolean value
-            y_found = TRUE;
-         }
-
-         // Get the z value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, V3_END, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->position.z = atof(value);
-
-            // Set boolean value
-            z_found = TRUE;
-         }
-
-         // Make sure that if ',' is next character, it moves past it
-         if (*c == VALUE_SEP && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-         }
+      any_digits = TRUE;
+      cur++;
+   }
 
-         // Increment property count if all found
-         prop_count++;
-      }
-      else if (strcmp(property, "direction") == 0)
+   // Read fraction digits
+   if (cur < end && *cur == '.')
+   {
+      cur++;
+      while (cur < end && *cur >= '0' && *cur <= '9')
       {
-         // Since value is property, get everything up to "["
-         while (*c != LINE_TERM && isspace(*c))
+         if (mantissa != 0 || *cur != '0')
          {
-            *c = fgetc(file);
+            mantissa = mantissa * 10 + (*cur - '0');
+            digits++;
          }
-
-         // Get the x value
-         if (*c != EOF && *c == V3_START && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->direction.x = atof(value);
-
-            // Set boolean value
-            dx_found = TRUE;
-         }
-
-         // Get the y value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->direction.y = atof(value);
-
-            // Set boolean value
-            dy_found = TRUE;
-         }
-
-         // Get the z value
-         if (*c != EOF && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-            
-            // Get property value
-            get_next_word(value, V3_END, VALUE_LEN, file, c);
-
-            // Set property value
-            cur_obj->direction.z = atof(value);
-
-            // Set boolean value
-            dz_found = TRUE;
-         }
-
-         // Make sure that if ',' is next character, it moves past it
-         if (*c == VALUE_SEP && *c != LINE_TERM)
-         {
-            *c = fgetc(file);
-         }
-
-         // Increment property count if all found
-         prop_count++;
+         exponent--;
+         any_digits = TRUE;
+         cur++;
       }
-      else if (strcmp(property, "theta") == 0)
-      {
-         // Get property value
-         get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-         // Set property value
-         cur_obj->theta = atof(value);
+   }
 
-         // Set boolean value
-         theta_found = TRUE;
+   // Read exponent
+   if (any_digits && cur < end && (*cur == 'e' || *cur == 'E'))
+   {
+      const char *mark = cur++;
+      bool exp_negative = FALSE;
+      int exp_value = 0;
 
-         // Increment the prop count
-         prop_count++;
-      }
-      else if (strcmp(property, "radial-a0") == 0)
+      if (cur < end && (*cur == '-' || *cur == '+'))
       {
-         // Get property value
-         get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-         // Determine if valid value
-         if (atof(value) >= 0 && atof(value) <= 1)
-         {
-            // Set property value
-            cur_obj->radial_a0 = atof(value);
-
-            // Set boolean value
-            radial_a0_found = TRUE;
-
-            // Increment the prop count
-            prop_count++;
-         }
+         exp_negative = *cur == '-';
+         cur++;
       }
-      else if (strcmp(property, "radial-a1") == 0)
-      {
-         // Get property value
-         get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-         // Determine if valid value
-         if (atof(value) >= 0 && atof(value) <= 1)
-         {
-            // Set property value
-            cur_obj->radial_a1 = atof(value);
 
-            // Set boolean value
-            radial_a1_found = TRUE;
-
-            // Increment the prop count
-            prop_count++;
-         }
-      }
-      else if (strcmp(property, "radial-a2") == 0)
+      // Only treat it as an exponent if digits follow
+      if (cur < end && *cur >= '0' && *cur <= '9')
       {
-         // Get property value
-         get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-         // Determine if valid value
-         if (atof(value) >= 0 && atof(value) <= 1)
+         while (cur < end && *cur >= '0' && *cur <= '9')
          {
-            // Set property value
-            cur_obj->radial_a2 = atof(value);
-
-            // Set boolean value
-            radial_a2_found = TRUE;
-
-            // Increment the prop count
-            prop_count++;
-         }
-      }
-      else if (strcmp(property, "angular-a0") == 0)
-      {
-         // Get property value
-         get_next_word(value, VALUE_SEP, VALUE_LEN, file, c);
-
-         // Determine if valid value
-         if (atof(value) >= 0 && atof(value) <= 1)
-         {
-            // Set property value
-            cur_obj->angular_a0 = atof(value);
-
-            // Set boolean value
-            angular_a0_found = TRUE;
-
-            // Increment the prop count
-            prop_count++;
+            exp_value = exp_value < 10000 ? exp_value * 10 + (*cur - '0') : exp_value;
+            cur++;
          }
+         exponent += exp_negative ? -exp_value : exp_value;
       }
       else
       {
-         *result = INPUT_INVALID;
+         cur = mark;
       }
-
-      // Clear values
-      property[0] = STR_END;
-      value[0] = STR_END;
-   }
-
-   // Return error code if required values are not found
-   if (r_found == TRUE && g_found == TRUE && b_found == TRUE &&
-       x_found == TRUE && y_found == TRUE && z_found == TRUE &&
-       radial_a0_found == TRUE && radial_a1_found == TRUE && radial_a2_found == TRUE &&
-       ((((theta_found == FALSE) || (theta_found == TRUE && cur_obj->theta == 0)) &&
-       angular_a0_found == FALSE && dx_found == FALSE && dy_found == FALSE && dz_found == FALSE) ||
-       ((theta_found == TRUE && cur_obj->theta != 0) && angular_a0_found == TRUE && 
-       dx_found == TRUE && dy_found == TRUE && dz_found == TRUE)) &&
-       *result != INPUT_INVALID && prop_count <= LIGHT_VAL_COUNT)
-   {
-      *result = RUN_SUCCESS;
-   }
-   else
-   {
-      *result = INPUT_INVALID;
    }
-}
 
-// Helper method used to retrieve word from file
-void get_next_word(char *word, char delim, int max_len, FILE *file, char *c)
-{
-   // Variable declarations
-   int index = 0;
-
-   // Start by stripping white-space from front of word
-   while (isspace(*c))
+   // Nothing that looks like a number converts to 0, just like atof, but words
+   // like inf or nan are left to the C library
+   *stop = cur;
+   if (any_digits == FALSE && (cur >= end || isalpha(*cur) == 0))
    {
-      *c = fgetc(file);
+      return 0;
    }
 
-   // While deliminator is not reached, continue searching for word
-   while (*c != delim && index < max_len && *c != LINE_TERM && *c != EOF)
+   // Fast path: both the digits and the power of ten are exact
+   if (any_digits == TRUE && digits <= 15 && exponent >= -22 && exponent <= 22)
    {
-      word[index] = *c;
-      *c = fgetc(file);
-      index++;
-   }
+      double result = (double)mantissa;
 
-   // If character is end of file, return error code
-   if (*c != EOF && *c != LINE_TERM)
-   {
-      *c = fgetc(file);
+      result = exponent < 0 ? result / exact_pow10[-exponent] : result * exact_pow10[exponent];
+      return negative ? -result : result;
    }
 
-   // Set ending character
-   word[index] = STR_END;
+   // Slow path: copy the word so strtod sees a terminated string
+   len = end - start < VALUE_LEN - 1 ? end - start : VALUE_LEN - 1;
+   memcpy(copy, start, len);
+   copy[len] = STR_END;
+   return strtod(copy, NULL);
 }
-
-
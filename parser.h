@@ -9,8 +9,6 @@
 #define STR_END '\0'
 #define V3_START '['
 #define V3_END ']'
-#define TYPE_LEN 10
-#define PROPERTY_LEN 20
 #define VALUE_LEN 20
 
 #define CAM_VAL_COUNT 2
@@ -18,6 +16,20 @@
 #define PLANE_VAL_COUNT 8
 #define LIGHT_VAL_COUNT 8
 
+#define FIELD_MIN 1
+#define FIELD_MAX 2
+#define FIELD_STRICT 4
+
+#define GROUP_REQUIRED 0
+#define GROUP_ALL_OR_NONE 1
+#define GROUP_CUSTOM 2
+#define MAX_GROUPS 8
+#define LIGHT_THETA_GROUP 3
+#define LIGHT_SPOT_GROUP 4
+
+#define PROPERTY_SLOTS 64
+#define SCHEMA_COUNT 4
+
 #define WIDTH_INVALID 1
 #define HEIGHT_INVALID 2
 #define INPUT_INVALID 3
@@ -3,29 +3,56 @@
 #include <string.h>
 #include <math.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
 #include "ib_3dmath.h"
 #include "raycast.h"
 #include "parser.h"
+#include "bvh.h"
+#include "scene.h"
+#include "scenefile.h"
+#include "options.h"
+#include "tiles.h"
+#include "framebuffer.h"
+#include "timer.h"
+#include "packet.h"
+#include "isa.h"
+#include "wavefront.h"
+#include "stats.h"
+#include "heatmap.h"
 
 // Forward declarations
 void create_node(obj *data, linked_list *list);
-void add_rgb(rgb *data, rgb_list *list);
-void render(int *width, int *height, linked_list *objs, rgb_list *color_buff);
-void sphere_intersection(ib_v3 *r0, ib_v3 *rd, obj *cur_obj, float *t);
-void plane_intersection(ib_v3 *r0, ib_v3 *rd, obj *cur_obj, float *t);
-void write_file(rgb_list *colors, int *width, int *height, char *file_name);
-float clamp(float value, float min, float max);
-bool shadowed(ib_v3 *ro, ib_v3 *rdn, float *dist, int *closest_index, linked_list *list);
-rgb shoot(ib_v3 rd, ib_v3 r0, linked_list *objs, int depth, int inside);
+int compile_file(char *input_name, char *output_name);
+void render(scene *scn, options *opts, framebuffer *fb, render_stats *totals, float *heat);
+void write_heatmap(float *heat, int width, int height, char *output_name, int *result);
+void write_file(framebuffer *fb, char *file_name, int *result);
 
+// The microbenchmarks link everything below and bring their own main
+#ifndef RAYCAST_NO_MAIN
 int main(int argc, char* argv[])
 {
    // Variable declarations
    int width;
    int height;
    linked_list objs = { malloc(sizeof(obj_node)), malloc(sizeof(obj_node)), malloc(sizeof(obj_node)), 0 };
-   rgb_list color_buff = { malloc(sizeof(rgb_node)), malloc(sizeof(rgb_node)), 0 };
+   framebuffer fb;
+   scene scn;
+   options opts;
    int run_result;
+   double start;
+   double phases[PHASE_COUNT] = { 0 };
+   render_stats totals;
+   float *heat = NULL;
+   bool loaded;
+
+   // Convert a text scene to the compiled format instead of rendering
+   if (argc == COMPILE_ARGS && strcmp(argv[1], COMPILE_OPTION) == 0)
+   {
+      return compile_file(argv[2], argv[3]);
+   }
 
    // Relay error message if incorrect number of arguments were entered
    if (argc < MIN_ARGS)
@@ -52,16 +79,87 @@ int main(int argc, char* argv[])
          return RUN_FAIL;
       }
 
-      // Start by parsing file input
-      parse(&objs, argv[3], &run_result);
+      // Read the optional settings
+      parse_options(&opts, argc, argv, &run_result);
+      if (run_result != RUN_SUCCESS)
+      {
+         return RUN_FAIL;
+      }
+
+      // Use the kernels built for the chosen instruction set level
+      select_kernels(opts.isa);
+
+      // Start by reading file input, mapping compiled scenes and parsing text ones
+      start = ib_now();
+      loaded = is_scene_file(argv[3]);
+      if (loaded == TRUE)
+      {
+         load_scene(&scn, argv[3], &run_result);
+      }
+      else
+      {
+         parse(&objs, argv[3], &run_result);
+      }
+      phases[PHASE_PARSE] = ib_now() - start;
 
       // Raycast objects if parse was successful
       if (run_result == RUN_SUCCESS)
       {  
+         // Flatten the parsed objects into packed arrays and build the bvh
+         start = ib_now();
+         if (loaded == FALSE)
+         {
+            compile_scene(&scn, &objs);
+         }
+         create_framebuffer(&fb, width, height);
+         if (opts.heatmap != HEATMAP_OFF)
+         {
+            heat = malloc(sizeof(float) * (size_t)width * height);
+         }
+         phases[PHASE_PREPROCESS] = ib_now() - start;
+
+         // Relay error message if the image does not fit in memory
+         if (fb.bytes == NULL || (opts.heatmap != HEATMAP_OFF && heat == NULL))
+         {
+            fprintf(stderr, "Error: There is not enough memory for a %d by %d image. (err no. %d)\n", width, height, MEMORY_INVALID);
+            free_framebuffer(&fb);
+            free(heat);
+            free_scene(&scn);
+            return RUN_FAIL;
+         }
+
          // Calculate rgb values at each pixel
-         render(&width, &height, &objs, &color_buff);
+         start = ib_now();
+         render(&scn, &opts, &fb, &totals, heat);
+         phases[PHASE_RENDER] = ib_now() - start;
+
          // Write the output to the file
-         write_file(&color_buff, &width, &height, argv[4]);
+         start = ib_now();
+         write_file(&fb, argv[4], &run_result);
+         free_framebuffer(&fb);
+         if (heat != NULL && run_result == RUN_SUCCESS)
+         {
+            write_heatmap(heat, width, height, argv[4], &run_result);
+         }
+         free(heat);
+         phases[PHASE_WRITE] = ib_now() - start;
+
+         // Report where the time went and how much work the rays took
+         if (opts.stats != STATS_NONE)
+         {
+            report_stats(&opts, loaded, phases, &totals);
+         }
+
+         // Relay error message if the output could not be written
+         if (run_result != RUN_SUCCESS)
+         {
+            fprintf(stderr, "Error: The output file could not be written. (err no. %d)\n", run_result);
+            free_scene(&scn);
+            return RUN_FAIL;
+         }
+
+         // Release the compiled scene
+         free_scene(&scn);
       }
       // If parse was unsuccessful, display error message and code
       else
@@ -72,411 +170,262 @@ int main(int argc, char* argv[])
    
    return RUN_SUCCESS;
 }
+#endif
+
+// Used to parse a text scene and write it out in the compiled format
+int compile_file(char *input_name, char *output_name)
+{
+   // Variable declarations
+   linked_list objs = { malloc(sizeof(obj_node)), malloc(sizeof(obj_node)), malloc(sizeof(obj_node)), 0 };
+   scene scn;
+   int run_result;
+
+   // Start by parsing file input
+   parse(&objs, input_name, &run_result);
+   if (run_result != RUN_SUCCESS)
+   {
+      fprintf(stderr, "Error: There was a problem parsing your input file. Please correct the file and try again. (err no. %d)\n", run_result);
+      return RUN_FAIL;
+   }
+
+   // Flatten the objects, build the bvh and store the result
+   compile_scene(&scn, &objs);
+   save_scene(&scn, output_name, &run_result);
+   free_scene(&scn);
+
+   // Relay error message if the output could not be written
+   if (run_result != RUN_SUCCESS)
+   {
+      fprintf(stderr, "Error: The output file could not be written. (err no. %d)\n", run_result);
+      return RUN_FAIL;
+   }
+
+   return RUN_SUCCESS;
+}
 
-// Used to render the scene given parsed objects
-void render(int *width, int *height, linked_list *objs, rgb_list *color_buff)
+// Used to render the scene given parsed objects, adding up the render threads'
+// counters in totals and each pixel's cost in heat unless it is NULL
+void render(scene *scn, options *opts, framebuffer *fb, render_stats *totals, float *heat)
 {
    // Variable declarations
-   int rows;
-   int cols;
-   ib_v3 rd;
-   rgb cur_rgb = { 0, 0, 0 };
-   float cam_width = objs->main_camera->obj_ref.width;
-   float cam_height = objs->main_camera->obj_ref.height;
-   double px_width = cam_width / *width;
-   double px_height = cam_height / *height;
+   frame_terms frame;
    ib_v3 r0 = { 0.0, 0.0, 0.0 }; // Initialize camera position
+   render_job job = { scn, &frame, opts, fb->width, fb->height, fb };
+
+   // Start the totals from zero before the threads add to them
+   memset(totals, 0, sizeof(render_stats));
+   job.stats = totals;
+   job.heat = heat;
+
+   // Work out everything primary rays share once for the whole frame
+   prepare_frame(&frame, scn, &r0);
+   prepare_prune(&job);
+
+   // Render every tile into the shared framebuffer
+   run_tiles(&job, trace_tile);
+   totals->workers = job.worker_count;
+   free_frame(&frame);
+   free(job.prune_bound);
+}
+
+// Used to find the normalized direction of the primary ray through a pixel
+void primary_ray(render_job *job, int x, int y, ib_v3 *rd)
+{
+   // Variable declarations
+   float cam_width = job->scn->cam_width;
+   float cam_height = job->scn->cam_height;
+   double px_width = cam_width / job->width;
+   double px_height = cam_height / job->height;
    float pz = -1; // Given distance from camera to viewport (negative z axis)
    float py;
    float px;
-   int depth = 0;
-   int inside = 0;
 
-   // Loop for as many columns in image
-   for (cols = *height - 1; cols >= 0 ; cols-=1) // Start from top to bottom. Makes +y axis upward direction.
-   {
-      // Calculate py first
-      py = CENTER_XY - cam_height  / 2.0 + px_height * (cols + 0.5);
+   // Image rows run top to bottom. Makes +y axis upward direction.
+   int cols = job->height - 1 - y;
 
-      // Loop for as many rows as possible
-      for (rows = 0; rows < *width; rows+=1)
-      {
-         // Calculate px
-         px = CENTER_XY - cam_width / 2.0 + px_width * (rows + 0.5);
+   // Calculate py first
+   py = CENTER_XY - cam_height  / 2.0 + px_height * (cols + 0.5);
 
-         // Combine variables into rd vector
-         rd.x = px;
-         rd.y = py;
-         rd.z = pz;
+   // Calculate px
+   px = CENTER_XY - cam_width / 2.0 + px_width * (x + 0.5);
 
-         // Normalize the vector
-         ib_v3_normalize(&rd);
+   // Combine variables into rd vector
+   rd->x = px;
+   rd->y = py;
+   rd->z = pz;
 
-         // Recursively call the shooting method
-         cur_rgb = shoot(rd, r0, objs, depth, inside);
-         
-         // Clamp final color values
-         cur_rgb.r = clamp(cur_rgb.r, 0, 1);
-         cur_rgb.g = clamp(cur_rgb.g, 0, 1);
-         cur_rgb.b = clamp(cur_rgb.b, 0, 1);
-
-         // Scale color value
-         cur_rgb.r = cur_rgb.r * 255;
-         cur_rgb.g = cur_rgb.g * 255;
-         cur_rgb.b = cur_rgb.b * 255;
-
-         // Now append the color value to the buffer
-         add_rgb(&cur_rgb, color_buff);
-         
-         // Clear rgb and t values
-         cur_rgb.r = 0;
-         cur_rgb.g = 0;
-         cur_rgb.b = 0;
-      }
-   }
+   // Normalize the vector
+   ib_v3_normalize(rd);
 }
 
-// Use recursive shooting method to render objects
-rgb shoot(ib_v3 rd, ib_v3 r0, linked_list *objs, int depth, int inside)
+// Used to find the cone around every primary ray of a tile, from the rays
+// through its corner pixels
+void tile_bounds(render_job *job, tile *cur_tile, tile_cone *cone)
 {
    // Variable declarations
-   rgb cur_rgb = { 0,0,0 };
-   float refractivity;
-   float reflectivity;
-   float ior;
-   float t = INFINITY;
-   float cur_t = t;
-   obj_node *cur_obj = objs->first;
-   obj_node closest;
-   int closest_index = 0;
-
-   // Determine if base case has been hit
-   if (depth > MAX_RECURSION)
+   ib_v3 corners[4];
+   double length;
+   double cos_angle;
+
+   // The corner rays bound every ray in between
+   primary_ray(job, cur_tile->x0, cur_tile->y0, &corners[0]);
+   primary_ray(job, cur_tile->x1 - 1, cur_tile->y0, &corners[1]);
+   primary_ray(job, cur_tile->x0, cur_tile->y1 - 1, &corners[2]);
+   primary_ray(job, cur_tile->x1 - 1, cur_tile->y1 - 1, &corners[3]);
+
+   // Point the axis at the middle of the corners
+   cone->axis_x = (double)corners[0].x + corners[1].x + corners[2].x + corners[3].x;
+   cone->axis_y = (double)corners[0].y + corners[1].y + corners[2].y + corners[3].y;
+   cone->axis_z = (double)corners[0].z + corners[1].z + corners[2].z + corners[3].z;
+   length = sqrt(cone->axis_x * cone->axis_x + cone->axis_y * cone->axis_y + cone->axis_z * cone->axis_z);
+   cone->axis_x /= length;
+   cone->axis_y /= length;
+   cone->axis_z /= length;
+
+   // Widen the cone until it holds the furthest corner
+   cone->angle = 0;
+   for (int corner = 0; corner < 4; corner++)
    {
-      return cur_rgb;
+      cos_angle = cone->axis_x * corners[corner].x + cone->axis_y * corners[corner].y + cone->axis_z * corners[corner].z;
+      cos_angle = cos_angle > 1 ? 1 : cos_angle;
+      if (acos(cos_angle) > cone->angle)
+      {
+         cone->angle = acos(cos_angle);
+      }
    }
+}
 
-   // Loop through each object and test for intersections
-   for (int index = 0; index < objs->size; index+=1)
+// Helper method used to calculate the diffuse and specular light from one light
+rgb shade_light(light *cur_light, material *mat, ib_v3 *ni, ib_v3 *rd, ib_v3 *rdn, float dist)
+{
+   // Init N, L, R, and V light values
+   ib_v3 li;
+   ib_v3 ri;
+   ib_v3 vi;
+   rgb cur_rgb;
+   
+   // Init current diffuse and specular value of current object
+   rgb diff = mat->diffuse_color;
+   rgb spec = mat->specular_color;
+   
+   // Set Li
+   li = *rdn;
+   
+   // Calculate reflection
+   float dot_val;
+   ib_v3_dot(&dot_val, ni, &li);
+   ib_v3_scale(&ri, 2.0*dot_val, ni);
+   ib_v3_sub(&ri, &ri, &li);
+   ib_v3_scale(&vi, -1, rd);
+   
+   // Calculate default f radial value
+   float frad = 1.0/(cur_light->radial_a2*(dist*dist) + 
+   cur_light->radial_a1*dist + 
+   cur_light->radial_a0);
+
+   // Calculate default f angular value
+   float fang;
+   
+   // Determine if point light
+   if(cur_light->spot == FALSE)
    {
-      // Call intersection based on object type
-      if (cur_obj->obj_ref.type == SPHERE)
+      fang = 1.0;
+   }
+   // Otherwise, it is a spot light
+   else
+   {
+      float cur_dot;
+      ib_v3_dot(&cur_dot, rdn, &(cur_light->direction));
+   
+      // Determine fang value based on dot product
+      if(cur_light->cos_theta > cur_dot)
       {
-         sphere_intersection(&r0, &rd, &(cur_obj->obj_ref), &cur_t);
-
-         // If current t is smaller than current smallest, set values
-         if (cur_t < t)
-         {
-            t = cur_t;
-            closest = *cur_obj;
-            closest_index = index;
-         }
+        fang = 0.0;
       }
-      else if (cur_obj->obj_ref.type == PLANE)
+      else
       {
-         plane_intersection(&r0, &rd, &(cur_obj->obj_ref), &cur_t);
-
-         // If current t is smaller than current smallest, set values
-         if (cur_t < t && cur_t > 0)
-         {
-            t = cur_t;
-            closest = *cur_obj;
-            closest_index = index;
-         }
+        fang = pow(cur_dot, cur_light->angular_a0);
       }
-
-      // Move to next object
-      cur_obj = cur_obj->next;
    }
+   
+   // Init final diffuse values
+   ib_v3 diffuse_calc = { 0,0,0 };
+   ib_v3 specular_calc = { 0,0,0 };
+   
+   // Calculate dot products
+   float nl_dot = 0;
+   ib_v3_dot(&nl_dot, ni, &li);
+   float vr_dot = 0;
+   ib_v3_dot(&vr_dot, &vi, &ri);
+   
+   // If nl is greater than 0, calculate diffuse values
+   if(nl_dot > 0)
+   {
+      diffuse_calc.x = cur_light->color.r * diff.r;
+      diffuse_calc.y = cur_light->color.g * diff.g;
+      diffuse_calc.z = cur_light->color.b * diff.b;
 
-   // Reset traverser
-   cur_obj = objs->first;        
+      ib_v3_scale(&diffuse_calc, nl_dot, &diffuse_calc);
 
-   // Determine if color data is necessary
-   if (t != INFINITY && t > 0)
-   {
-      // Loop through lights in array
-      for (int index = 0; index < objs->size; index+=1)
+      // If vr is greater than 0, calculate specular value
+      if(vr_dot > 0)
       {
-         // Make sure it is a light object
-         if (cur_obj->obj_ref.type == LIGHT)
-         {
-            // Create new r0
-            ib_v3 ro;
-            ro.x = (t * rd.x) + r0.x;
-            ro.y = (t * rd.y) + r0.y;
-            ro.z = (t * rd.z) + r0.z;
-
-            // Create new rd
-            ib_v3 rdn;
-            rdn.x = cur_obj->obj_ref.position.x - ro.x;
-            rdn.y = cur_obj->obj_ref.position.y - ro.y;
-            rdn.z = cur_obj->obj_ref.position.z - ro.z;
-
-            // Calculate distance 
-            float dist;
-            ib_v3_len(&dist, &rdn);
-            ib_v3_normalize(&rdn);
-
-            // Determine if current object is in shadow of another
-            bool shadow = shadowed(&ro, &rdn, &dist, &closest_index, objs);
-            
-            // If no shadow, determine illumination
-            if (shadow == FALSE)
-            {
-               // Init N, L, R, and V light values
-               ib_v3 ni;
-               ib_v3 li;
-               ib_v3 ri;
-               ib_v3 vi;
-               
-               // Init current diffuse and specular value of current object
-               rgb diff;
-               rgb spec;
-               
-               // If plane, store normal as N
-               if (closest.obj_ref.type == PLANE)
-               {
-                  ni = closest.obj_ref.normal;
-               }
-               // If sphere, store difference between r0 and current object position
-               else if (closest.obj_ref.type == SPHERE)
-               {
-                  ib_v3_sub(&ni, &ro, &(closest.obj_ref.position));
-                  ib_v3_normalize(&ni);
-               }
-               
-               // Set the specular and diffuse colors
-               diff = closest.obj_ref.diffuse_color;
-               spec = closest.obj_ref.specular_color;
-               
-               // Set the refraction and reflection values
-               reflectivity = closest.obj_ref.reflectivity;
-               refractivity = closest.obj_ref.refractivity;
-               ior = closest.obj_ref.ior;
-               
-               // Set Li
-               li = rdn;
-               
-               // Calculate reflection
-               float dot_val;
-               ib_v3_dot(&dot_val, &ni, &li);
-               ib_v3_scale(&ri, 2.0*dot_val, &ni);
-               ib_v3_sub(&ri, &ri, &li);
-               ib_v3_scale(&vi, -1, &rd);
-               
-               // Calculate default f radial value
-               float frad = 1.0/(cur_obj->obj_ref.radial_a2*(dist*dist) + 
-               cur_obj->obj_ref.radial_a1*dist + 
-               cur_obj->obj_ref.radial_a0);
-
-               // Calculate default f angular value
-               float fang;
-               ib_v3 vli = cur_obj->obj_ref.direction;
-               ib_v3_normalize(&vli);
-               
-               // Determine if point light
-               if(cur_obj->obj_ref.theta == 0 || cur_obj->obj_ref.angular_a0 == 0)
-               {
-                  fang = 1.0;
-               }
-               // Otherwise, it is a spot light
-               else
-               {
-                  float target = cos(cur_obj->obj_ref.theta * 3.14159265 / 180.0);
-                  float cur_dot;
-                  ib_v3_dot(&cur_dot, &rdn, &vli);
-               
-                  // Determine fang value based on dot product
-                  if(target > cur_dot)
-                  {
-                    fang = 0.0;
-                  }
-                  else
-                  {
-                    fang = pow(cur_dot, cur_obj->obj_ref.angular_a0);
-                  }
-               }
-               
-               // Init final diffuse values
-               ib_v3 diffuse_calc = { 0,0,0 };
-               ib_v3 specular_calc = { 0,0,0 };
-               
-               // Calculate dot products
-               float nl_dot = 0;
-               ib_v3_dot(&nl_dot, &ni, &li);
-               float vr_dot = 0;
-               ib_v3_dot(&vr_dot, &vi, &ri);
-               
-               // If nl is greater than 0, calculate diffuse values
-               if(nl_dot > 0)
-               {
-                  diffuse_calc.x = cur_obj->obj_ref.color.r * diff.r;
-                  diffuse_calc.y = cur_obj->obj_ref.color.g * diff.g;
-                  diffuse_calc.z = cur_obj->obj_ref.color.b * diff.b;
-  
-                  ib_v3_scale(&diffuse_calc, nl_dot, &diffuse_calc);
-
-                  // If vr is greater than 0, calculate specular value
-                  if(vr_dot > 0)
-                  {
-                     specular_calc.x = cur_obj->obj_ref.color.r * spec.r;
-                     specular_calc.y = cur_obj->obj_ref.color.g * spec.g;
-                     specular_calc.z = cur_obj->obj_ref.color.b * spec.b;
-                     
-                     // Add shinniness value to calculation
-                     ib_v3_scale(&specular_calc, pow(vr_dot, SHINE_DEFAULT), &specular_calc);
-                  }
-                  // If not, keep at 0 value
-                  else
-                  {
-                     specular_calc.x = 0;
-                     specular_calc.y = 0;
-                     specular_calc.z = 0;
-                  }
-               }
-               
-               // Calculate final diffuse and specular values
-          	   cur_rgb.r += frad * fang * clamp(diffuse_calc.x + specular_calc.x, 0, 1);
-          	   cur_rgb.g += frad * fang * clamp(diffuse_calc.y + specular_calc.y, 0, 1);
-               cur_rgb.b += frad * fang * clamp(diffuse_calc.z + specular_calc.z, 0, 1);
-              	
-              	// Calculate the reflection/refraction values
-              	ib_v3 new_r0 = { 0,0,0 };
-              	new_r0.x = ro.x;
-              	new_r0.y = ro.y;
-              	new_r0.z = ro.z;
-              	ib_v3 new_rd = { 0,0,0 };
-              	rgb reflection_calc = { 0,0,0 };
-              	rgb refraction_calc = { 0,0,0 };
-              	
-              	// If reflectivity, calculate it
-              	if (reflectivity > 0)
-              	{
-              	   // Generate reflection value
-              	   float nrd;
-              	   ib_v3_dot(&nrd, &ni, &rd);
-              	   new_rd.x = rd.x - 2 * nrd * ni.x;
-              	   new_rd.y = rd.y - 2 * nrd * ni.y;
-              	   new_rd.z = rd.z - 2 * nrd * ni.z;
-              	   
-              	   // Calculte offset so object doesn't intersect with itself
-              	   ib_v3 offset = { new_rd.x * 0.0001, new_rd.y * 0.0001, new_rd.z * 0.0001 };
-              	   new_r0.x = new_r0.x + offset.x;
-              	   new_r0.y = new_r0.y + offset.y;
-              	   new_r0.z = new_r0.z + offset.z;
-              	   ib_v3_normalize(&new_rd);
-              	   
-              	   // Recursively call shooting method
-              	   reflection_calc = shoot(new_rd, new_r0, objs, depth + 1, inside);
-              	}
-              	
-              	// If refractivity, calculate it
-              	if (refractivity > 0)
-              	{
-              	   // Determine if value is currently inside sphere
-              	   if (inside == TRUE)
-              	   {
-              	      ior = 1 / ior;
-              	   }
-              	   
-              	   // If inside sphere, set value
-              	   if (cur_obj->obj_ref.type == SPHERE && inside == FALSE)
-              	   {
-              	      inside = TRUE;
-              	   }
-              	   // If just outside sphere, set
-              	   else if (cur_obj->obj_ref.type == SPHERE && inside == TRUE)
-              	   {
-              	      inside = FALSE;
-              	   }
-              	   
-              	   // a/b vectors
-              	   ib_v3 a = { 0,0,0 };
-              	   ib_v3 b = { 0,0,0 };
-              	   
-              	   // Sin/Cos values
-              	   float sinP;
-              	   float cosP;
-              	   
-              	   // Set a
-              	   a.x = ni.y * rd.z - ni.z * rd.y;
-              	   a.y = ni.z * rd.x - ni.x * rd.z;
-              	   a.z = ni.x * rd.y - ni.y * rd.x;
-              	   ib_v3_normalize(&a);
-              	   
-              	   // Set b
-              	   b.x = a.y * ni.z - a.z * ni.y;
-              	   b.y = a.z * ni.x - a.x * ni.z;
-              	   b.z = a.x * ni.y - a.y * ni.x;
-              	   ib_v3_normalize(&b);
-              	   
-              	   // Set sin and cos values
-              	   sinP = ior * (rd.x * b.x + rd.y * b.y + rd.z * b.z);
-              	   cosP = sqrt(1 - (sinP * sinP));
-              	   
-              	   // Set new rd value
-              	   new_rd.x = -(ni.x) * cosP + b.x * sinP;
-              	   new_rd.y = -(ni.y) * cosP + b.y * sinP;
-              	   new_rd.z = -(ni.z) * cosP + b.z * sinP;
-              	   
-     	            // Calculte offset so object doesn't intersect with itself
-              	   ib_v3 offset = { 0, 0, 0};
-              	   offset.x = new_rd.x * 0.0001;
-              	   offset.y = new_rd.y * 0.0001;
-              	   offset.z = new_rd.z * 0.0001; 
-              	   new_r0.x = new_r0.x + offset.x;
-              	   new_r0.y = new_r0.y + offset.y;
-              	   new_r0.z = new_r0.z + offset.z;
-              	   ib_v3_normalize(&new_rd);
-              	   
-              	   // Recursively call shooting method
-              	   refraction_calc = shoot(new_rd, new_r0, objs, depth + 1, inside);
-              	}
-
-               // Set the new color values with refraction/reflection incorporated
-               cur_rgb.r = (1 - reflectivity - refractivity) * cur_rgb.r + refraction_calc.r * refractivity + reflection_calc.r * reflectivity;
-               cur_rgb.g = (1 - reflectivity - refractivity) * cur_rgb.g + refraction_calc.g * refractivity + reflection_calc.g * reflectivity;
-               cur_rgb.b = (1 - reflectivity - refractivity) * cur_rgb.b + refraction_calc.b * refractivity + reflection_calc.b * reflectivity;
-            }
-         }
+         specular_calc.x = cur_light->color.r * spec.r;
+         specular_calc.y = cur_light->color.g * spec.g;
+         specular_calc.z = cur_light->color.b * spec.b;
          
-         // Traverse to next object
-         cur_obj = cur_obj->next;
+         // Add shinniness value to calculation
+         ib_v3_scale(&specular_calc, pow(vr_dot, SHINE_DEFAULT), &specular_calc);
       }
    }
    
-   // Return color value
+   // Calculate final diffuse and specular values
+   cur_rgb.r = frad * fang * clamp(diffuse_calc.x + specular_calc.x, 0, 1);
+   cur_rgb.g = frad * fang * clamp(diffuse_calc.y + specular_calc.y, 0, 1);
+   cur_rgb.b = frad * fang * clamp(diffuse_calc.z + specular_calc.z, 0, 1);
+
    return cur_rgb;
 }
 
 // Method used to find sphere intersection
-void sphere_intersection(ib_v3 *r0, ib_v3 *rd, obj *cur_obj, float *t)
+void sphere_intersection(ib_v3 *r0, ib_v3 *rd, sphere_set *spheres, int index, float *t)
+{
+   // Variable declarations
+   ib_v3 offset = { r0->x - spheres->x[index], r0->y - spheres->y[index], r0->z - spheres->z[index] };
+
+   sphere_offset_intersection(&offset, rd, spheres->radius2[index], t);
+}
+
+// Method used to find sphere intersection given the offset from its center to
+// the ray origin. The quadratic is solved with half of b, which drops the
+// factors of 2 and 4 exactly. Ray directions are unit length only to within
+// rounding, so a is kept to give the same roots bit for bit.
+void sphere_offset_intersection(ib_v3 *offset, ib_v3 *rd, float radius2, float *t)
 {
    // Variable declarations
    float a;
    float b;
    float c;
    float d;
+   float root;
    float t0;
    float t1;
 
    // Calculate a, b, and c values
    a = (rd->x * rd->x) + (rd->y * rd->y) + (rd->z * rd->z);
-   b = 2 * (rd->x * (r0->x - cur_obj->position.x) + rd->y * (r0->y - cur_obj->position.y) + rd->z * (r0->z - cur_obj->position.z));
-   c = ((r0->x - cur_obj->position.x) * (r0->x - cur_obj->position.x) + 
-        (r0->y - cur_obj->position.y) * (r0->y - cur_obj->position.y) + 
-        (r0->z - cur_obj->position.z) * (r0->z - cur_obj->position.z)) - (cur_obj->radius * cur_obj->radius);
+   b = rd->x * offset->x + rd->y * offset->y + rd->z * offset->z;
+   c = (offset->x * offset->x + offset->y * offset->y + offset->z * offset->z) - radius2;
 
    // Calculate descriminate value
-   d = (b * b - 4 * a * c);
+   d = b * b - a * c;
 
    // Only if descriminate is positive do we calculate intersection
    if (d > 0)
    {
-      // Calculate both t values
-      t0 = (-b + sqrtf(b * b - 4 * c * a)) / (2 * a);
-      t1 = (-b - sqrtf(b * b - 4 * c * a)) / (2 * a);
+      // Calculate both t values from one square root
+      root = sqrtf(d);
+      t0 = (-b + root) / a;
+      t1 = (-b - root) / a;
 
       // Determine which t value to return
       if (t1 > 0)
@@ -490,25 +439,24 @@ void sphere_intersection(ib_v3 *r0, ib_v3 *rd, obj *cur_obj, float *t)
    }
 }
 
-// Method used to find plane intersection
-void plane_intersection(ib_v3 *r0, ib_v3 *rd, obj *cur_obj, float *t)
+// Method used to find plane intersection. Normals are stored normalized, with
+// d measured along them.
+void plane_intersection(ib_v3 *r0, ib_v3 *rd, plane_set *planes, int index, float *t)
+{
+   plane_offset_intersection(planes->nx[index] * r0->x + planes->ny[index] * r0->y + planes->nz[index] * r0->z + planes->d[index],
+                             rd, planes, index, t);
+}
+
+// Method used to find plane intersection given n . r0 + d for the ray origin
+void plane_offset_intersection(float offset, ib_v3 *rd, plane_set *planes, int index, float *t)
 {
    // Variable declarations
-   float a;
-   float b;
-   float c;
-   float dist;
+   float a = planes->nx[index];
+   float b = planes->ny[index];
+   float c = planes->nz[index];
    float den;
-   ib_v3 normal = cur_obj->normal;
-   
-   // Normalize normal value and assign a, b, and c (for readability)
-   ib_v3_normalize(&normal);
-   a = cur_obj->normal.x;
-   b = cur_obj->normal.y;
-   c = cur_obj->normal.z; 
-
-   // Calculate dist and den values
-   dist = -(a * cur_obj->position.x + b * cur_obj->position.y + c * cur_obj->position.z);
+
+   // Calculate den value
    den = (a * rd->x + b * rd->y + c * rd->z);
 
    // If den = 0, return faulty t value
@@ -519,35 +467,84 @@ void plane_intersection(ib_v3 *r0, ib_v3 *rd, obj *cur_obj, float *t)
    // Otherwise, calculate and return t
    else
    {
-      *t = -(a * r0->x + b * r0->y + c * r0->z + dist) / den;
+      *t = -offset / den;
    }
 }
 
+// Helper method used to write the cost of every pixel as a false color image
+// next to the output
+void write_heatmap(float *heat, int width, int height, char *output_name, int *result)
+{
+   // Variable declarations
+   framebuffer heat_fb;
+   char heat_name[HEAT_NAME_LEN];
+
+   create_framebuffer(&heat_fb, width, height);
+   heat_image(heat, &heat_fb);
+   heat_file_name(output_name, heat_name);
+   write_file(&heat_fb, heat_name, result);
+   free_framebuffer(&heat_fb);
+}
+
 // Helper method used to write output to file
-void write_file(rgb_list *colors, int *width, int *height, char *file_name)
+void write_file(framebuffer *fb, char *file_name, int *result)
 {
    // Variable declarations
-   FILE *out_file;
-   int index = 0;
-   rgb_node *cur_color = colors->first;
+   char header[64];
+   int header_len;
+   int out_file;
+   struct iovec parts[2];
+   size_t remaining;
 
    // Start by opening file
-   if ((out_file = fopen(file_name, "wb")) != NULL)
+   if ((out_file = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
    {
-      // Start by writing header file
-      fprintf(out_file, "%s\n%d %d\n%d\n", "P6", *width, *height, 255);
-      
-      // Loop through each character and put character value
-      for (index = 0; index < colors->size; index++)
+      *result = OUTPUT_INVALID;
+      return;
+   }
+
+   // Write the header and the whole pixel buffer with one call
+   header_len = snprintf(header, sizeof(header), "%s\n%d %d\n%d\n", "P6", fb->width, fb->height, 255);
+   parts[0].iov_base = header;
+   parts[0].iov_len = header_len;
+   parts[1].iov_base = fb->bytes;
+   parts[1].iov_len = (size_t)fb->width * fb->height * FB_CHANNELS;
+   remaining = parts[0].iov_len + parts[1].iov_len;
+   *result = RUN_SUCCESS;
+
+   // Keep writing until the kernel has taken everything
+   while (remaining > 0)
+   {
+      // Variable declarations
+      ssize_t written = writev(out_file, parts, 2);
+
+      // Stop on a real error
+      if (written < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         *result = OUTPUT_INVALID;
+         break;
+      }
+
+      // Skip over whatever part of the buffers was written
+      remaining -= written;
+      for (int index = 0; index < 2; index++)
       {
-         // Using the %c format converts the integer value to its ascii equivalent
-         fprintf(out_file, "%c%c%c", (char)cur_color->color.r, (char)cur_color->color.g, (char)cur_color->color.b);
+         size_t used = (size_t)written < parts[index].iov_len ? (size_t)written : parts[index].iov_len;
 
-         cur_color = cur_color->next;
+         parts[index].iov_base = (char *)parts[index].iov_base + used;
+         parts[index].iov_len -= used;
+         written -= used;
       }
+   }
 
-      // Close file
-      fclose(out_file);
+   // Close file
+   if (close(out_file) != 0)
+   {
+      *result = OUTPUT_INVALID;
    }
 }
 
@@ -583,90 +580,12 @@ void create_node(obj *data, linked_list *list)
    }
 }
 
-// Helper function used to append a new color to the color buffer list
-void add_rgb(rgb *data, rgb_list *list)
+// Helper method used to return whether or not the current object is under a
+// shadow, and which object casts it
+bool shadowed(ib_v3 *ro, ib_v3 *rdn, float *dist, int *closest_index, scene *scn, int *blocker)
 {
-   // First, determine if this is first node in linked list
-   if (list->size == 0)
-   {
-      // Last and first are both the same
-      list->first = malloc(sizeof(rgb_node));
-      list->last = list->first;
-
-      // Allocate size for next object
-      list->last->next = malloc(sizeof(rgb_node));
-      
-      // Set node data
-      list->first->color = *data;
-      
-      // Increase size
-      list->size = 1;
-   }
-   // If not first, simply append object
-   else
-   {
-      // Apply data to new last node
-      list->last->next->color = *data;
-      list->last->next->next = malloc(sizeof(rgb_node));
-
-      // Increase size of linked list
-      list->last = list->last->next;
-      list->size = list->size + 1;
-   }
-}
-
-// Helper method used to return whether or not the current object is under a shadow
-bool shadowed(ib_v3 *ro, ib_v3 *rdn, float *dist, int *closest_index, linked_list *list)
-{
-   // Variable declarations
-   obj_node *shadow_node = list->first;
-   float closest_shadow_dist = INFINITY;
-   bool shadow = FALSE;
-   
-   // Check for shadows
-   for (int index = 0; index < list->size; index++)
-   {
-      // Skip the current object
-      if (*closest_index == index)
-      {
-         shadow_node = shadow_node->next;
-         continue;
-      }
-
-      // Check if intersection with plane
-      if (shadow_node->obj_ref.type == PLANE)
-      {
-         plane_intersection(ro, rdn, &(shadow_node->obj_ref), &closest_shadow_dist);
-      }
-      // Check if intersection with sphere
-      else if (shadow_node->obj_ref.type == SPHERE)
-      {
-         sphere_intersection(ro, rdn, &(shadow_node->obj_ref), &closest_shadow_dist);
-      }
-      // Otherwise, skip iteration because not object
-      else
-      {
-         shadow_node = shadow_node->next;
-         continue;
-      }
-
-      if (closest_shadow_dist > *dist)
-      {
-         shadow_node = shadow_node->next;
-         continue;
-      }
-
-      if (closest_shadow_dist < *dist && closest_shadow_dist > 0.0)
-      {
-         shadow = TRUE;
-      }
-
-      // Traverse to next node
-      shadow_node = shadow_node->next;
-   }
-   
-   // Return whether or not shadow was encountered
-   return shadow;
+   // Return as soon as any object other than the current one blocks the light
+   return bvh_occluded(scn, ro, rdn, dist, closest_index, blocker);
 }
 
 // Helper method used to return a clamped value between min and max
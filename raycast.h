@@ -1,10 +1,14 @@
 #ifndef RAYCAST
 #define RAYCAST
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include "ib_3dmath.h"
 
 #define RUN_SUCCESS 0
 #define RUN_FAIL 1
+#define MEMORY_INVALID 6
 #define MIN_ARGS 5
 #define TRUE 1
 #define FALSE 0
@@ -18,15 +22,67 @@
 
 #define SHINE_DEFAULT 20.0
 #define MAX_RECURSION 7
+#define MAX_DEPTH_LIMIT 64
+
+#define PRUNE_OFF 0
+#define PRUNE_ADAPTIVE 1
+
+#define SORT_OFF 0
+#define SORT_ON 1
+
+#define HEATMAP_OFF 0
+#define HEATMAP_RAYS 1
+#define HEATMAP_CYCLES 2
+
+#define SHADE_PER_LIGHT 0
+#define SHADE_ONCE 1
+
+#define STATS_NONE 0
+#define STATS_TEXT 1
+#define STATS_JSON 2
+
+#define SCENE_SECTIONS 14
+
+#define PACKET_MAX 16
+#define KERNEL_WIDTH 8
+#define KERNEL_ALIGN 64
 
 // Type definitions
 typedef int bool;
 typedef struct rgb rgb;
 typedef struct obj obj;
 typedef struct obj_node obj_node;
-typedef struct rgb_node rgb_node;
 typedef struct linked_list linked_list;
-typedef struct rgb_list rgb_list;
+typedef struct source source;
+typedef struct token token;
+typedef struct field_spec field_spec;
+typedef struct object_schema object_schema;
+typedef struct field_slot field_slot;
+typedef struct framebuffer framebuffer;
+typedef struct aabb aabb;
+typedef struct bvh_node bvh_node;
+typedef struct bvh bvh;
+typedef struct sphere_set sphere_set;
+typedef struct plane_set plane_set;
+typedef struct material material;
+typedef struct light light;
+typedef struct scene scene;
+typedef struct scene_header scene_header;
+typedef struct options options;
+typedef struct tile tile;
+typedef struct tile_deque tile_deque;
+typedef struct render_job render_job;
+typedef struct worker worker;
+typedef struct ray_packet ray_packet;
+typedef struct kernel_set kernel_set;
+typedef struct frame_terms frame_terms;
+typedef struct tile_cone tile_cone;
+typedef struct tile_entry tile_entry;
+typedef struct ray_queue ray_queue;
+typedef struct shadow_queue shadow_queue;
+typedef struct wavefront wavefront;
+typedef struct render_stats render_stats;
+typedef struct run_report run_report;
 
 // Color in rgb format
 struct rgb
@@ -67,13 +123,6 @@ struct obj_node
    obj obj_ref;
 };
 
-// Struct used as a node for an rgb value
-struct rgb_node
-{
-   rgb_node *next;
-   rgb color;
-};
-
 // Linked list structure
 struct linked_list
 {
@@ -83,15 +132,388 @@ struct linked_list
    int size;
 };
 
-// Rgb list structure
-struct rgb_list
+// Byte range of a mapped input file being read
+struct source
 {
-   rgb_node *first;
-   rgb_node *last;
-   int size;
+   const char *cur;
+   const char *end;
+};
+
+// Word found in the input, pointing straight into the mapped file
+struct token
+{
+   const char *start;
+   int len;
+};
+
+// One property of an object line: where its floats live in obj, how many
+// there are, which values are accepted and which validation group it is in
+struct field_spec
+{
+   const char *name;
+   size_t offset;
+   int arity;
+   int flags;
+   float min;
+   float max;
+   int group;
+};
+
+// Everything needed to read and validate one kind of object line
+struct object_schema
+{
+   const char *name;
+   int type;
+   const field_spec *fields;
+   int field_count;
+   const int *group_rules;
+   int group_count;
+   int max_props;
+   bool (*check)(obj *cur_obj, unsigned int found, const unsigned int *masks);
+};
+
+// Entry of the hashed property lookup table
+struct field_slot
+{
+   const object_schema *schema;
+   const field_spec *field;
+   int name_len;
+   int first_bit;
+};
+
+// Flat image storage; bytes holds packed rgb triples in scanline order
+struct framebuffer
+{
+   int width;
+   int height;
+   unsigned char *bytes;
+};
+
+// Axis aligned bounding box
+struct aabb
+{
+   ib_v3 min;
+   ib_v3 max;
+};
+
+// Flattened tree node. Interior nodes store the index of their left child (the
+// right child always follows it), leaves store the first sphere and a count.
+struct bvh_node
+{
+   aabb bounds;
+   int left_first;
+   int count;
+};
+
+// Bounding volume hierarchy over the spheres of a scene
+struct bvh
+{
+   bvh_node *nodes;
+   int node_count;
+};
+
+// Hot sphere data read by intersection tests, stored as parallel arrays
+struct sphere_set
+{
+   float *x;
+   float *y;
+   float *z;
+   float *radius2;
+   int count;
+};
+
+// Plane data stored as parallel arrays. Intersection tests read the unit normal
+// and the distance along it; shading reads the normal as the scene gives it.
+struct plane_set
+{
+   float *nx;
+   float *ny;
+   float *nz;
+   float *d;
+   float *sx;
+   float *sy;
+   float *sz;
+   int count;
+};
+
+// Cold surface data that is only read after a hit. local_weight is the share of
+// direct light left over after reflection and refraction.
+struct material
+{
+   rgb diffuse_color;
+   rgb specular_color;
+   float reflectivity;
+   float refractivity;
+   float ior;
+   float local_weight;
+};
+
+// Light prepared for shading. Spot lights store a unit direction and the
+// cosine of their cone angle.
+struct light
+{
+   ib_v3 position;
+   rgb color;
+   float radial_a0;
+   float radial_a1;
+   float radial_a2;
+   float angular_a0;
+   ib_v3 direction;
+   float cos_theta;
+   bool spot;
+};
+
+// Compiled scene. Primitive ids number the spheres first, then the planes, and
+// index the material array. When mapping is set the arrays point into a loaded
+// scene file instead of owning their memory.
+struct scene
+{
+   sphere_set spheres;
+   plane_set planes;
+   material *materials;
+   light *lights;
+   int light_count;
+   bvh tree;
+   float cam_width;
+   float cam_height;
+   void *mapping;
+   size_t mapping_size;
+};
+
+// Start of a compiled scene file. Every section is a raw array of the
+// matching scene data, found at its offset from the start of the file.
+struct scene_header
+{
+   char magic[8];
+   uint32_t version;
+   uint32_t byte_order;
+   uint32_t material_size;
+   uint32_t light_size;
+   uint32_t node_size;
+   int32_t sphere_count;
+   int32_t plane_count;
+   int32_t light_count;
+   int32_t node_count;
+   float cam_width;
+   float cam_height;
+   uint64_t file_size;
+   uint64_t offsets[SCENE_SECTIONS];
+};
+
+// Settings given on the command line
+struct options
+{
+   int shade_mode;
+   int threads;
+   int tile_size;
+   int stats;
+   int packet;
+   int isa;
+   int prune;
+   int max_depth;
+   int sort;
+   int heatmap;
+};
+
+// Rectangle of pixels rendered as one unit of work
+struct tile
+{
+   int x0;
+   int y0;
+   int x1;
+   int y1;
+};
+
+// Work-stealing deque of tile indices. The owner pops from the bottom while
+// other workers steal from the top.
+struct tile_deque
+{
+   int *items;
+   atomic_long top;
+   atomic_long bottom;
+};
+
+// Everything shared by the workers of one render
+struct render_job
+{
+   scene *scn;
+   frame_terms *frame;
+   options *opts;
+   int width;
+   int height;
+   framebuffer *fb;
+   tile *tiles;
+   int tile_count;
+   tile_deque *deques;
+   int worker_count;
+   double *prune_bound;
+   bool prune_saturated;
+   render_stats *stats;
+   float *heat;
+};
+
+// Counters kept by each render thread and summed for the report. Tests count
+// one ray against one primitive or box, so a packet counts every lane. workers
+// is the number of render threads the render actually started.
+struct render_stats
+{
+   int workers;
+   long primary_rays;
+   long secondary_rays;
+   long shadow_rays;
+   long pruned_rays;
+   long sphere_tests;
+   long plane_tests;
+   long box_tests;
+   long cache_tests;
+   long cache_hits;
+   long depth_rays[MAX_DEPTH_LIMIT + 1];
+   double secondary_time;
+};
+
+// What one run of the raycaster reported, as the bench and check harnesses
+// read it back from --stats=text, with the time and memory the run took
+struct run_report
+{
+   double parse_ms;
+   double render_ms;
+   double write_ms;
+   double total_ms;
+   long rays;
+   long peak_kb;
+   bool counted;
+};
+
+// Rays of one generation of a tile, one array per field. Each ray carries the
+// weight its color adds to its pixel with, in place of the recursion that used
+// to scale it on the way back up, and the share of its pixel's pruning error
+// budget that it and the rays it spawns may still leave out.
+struct ray_queue
+{
+   float *ox;
+   float *oy;
+   float *oz;
+   float *dx;
+   float *dy;
+   float *dz;
+   float *weight;
+   float *budget;
+   int *pixel;
+   float *t;
+   int *hit;
+   float *hx;
+   float *hy;
+   float *hz;
+   float *nx;
+   float *ny;
+   float *nz;
+   float *spawn;
+   int count;
+   int capacity;
+};
+
+// Shadow rays of one generation, one for every hit and light in that order
+struct shadow_queue
+{
+   float *dx;
+   float *dy;
+   float *dz;
+   float *dist;
+   bool *occluded;
+   int count;
+   int capacity;
+};
+
+// Queues a render thread reuses for every tile it traces
+struct wavefront
+{
+   ray_queue rays[2];
+   shadow_queue shadows;
+   rgb *colors;
+   float *costs;
+   int color_capacity;
+   int *occluders;
+   uint64_t *keys;
+   int *order;
+   int order_capacity;
+};
+
+// State owned by a single render thread
+struct worker
+{
+   int id;
+   render_job *job;
+   wavefront wave;
+};
+
+// Rays sharing one origin, stored one array per component so each one loads
+// straight into a vector. Inactive lanes are ignored and keep no hit.
+struct ray_packet
+{
+   float ox;
+   float oy;
+   float oz;
+   float dx[PACKET_MAX] __attribute__((aligned(64)));
+   float dy[PACKET_MAX] __attribute__((aligned(64)));
+   float dz[PACKET_MAX] __attribute__((aligned(64)));
+   float inv_dx[PACKET_MAX] __attribute__((aligned(64)));
+   float inv_dy[PACKET_MAX] __attribute__((aligned(64)));
+   float inv_dz[PACKET_MAX] __attribute__((aligned(64)));
+   int active[PACKET_MAX] __attribute__((aligned(64)));
+   float t[PACKET_MAX] __attribute__((aligned(64)));
+   int hit[PACKET_MAX] __attribute__((aligned(64)));
+};
+
+// Terms of the intersection tests that only depend on the ray origin, worked out
+// once per frame for the primary rays, which all start at the camera. Arrays are
+// padded like the primitive arrays they follow.
+struct frame_terms
+{
+   ib_v3 origin;
+   float *ox;
+   float *oy;
+   float *oz;
+   float *plane_offset;
+};
+
+// Cone from the camera that holds every primary ray of a tile
+struct tile_cone
+{
+   double axis_x;
+   double axis_y;
+   double axis_z;
+   double angle;
+};
+
+// Bvh subtree the primary rays of a tile can enter, with a lower bound on the
+// distance to anything inside it
+struct tile_entry
+{
+   int node;
+   float near;
+};
+
+// Intersection kernels built for one instruction set level
+struct kernel_set
+{
+   void (*spheres_closest)(sphere_set *spheres, int first, int count, ib_v3 *r0, ib_v3 *rd, float *t, int *hit);
+   int (*spheres_occluder)(sphere_set *spheres, int first, int count, ib_v3 *r0, ib_v3 *rd, float dist, int skip);
+   void (*planes_closest)(plane_set *planes, int id_base, ib_v3 *r0, ib_v3 *rd, float *t, int *hit);
+   int (*planes_occluder)(plane_set *planes, int id_base, ib_v3 *r0, ib_v3 *rd, float dist, int skip);
+   void (*spheres_closest_frame)(frame_terms *frame, sphere_set *spheres, int first, int count, ib_v3 *rd, float *t, int *hit);
+   void (*planes_closest_frame)(frame_terms *frame, plane_set *planes, int id_base, ib_v3 *rd, float *t, int *hit);
 };
 
 // Forward declarations
 void create_node(obj *data, linked_list *list);
+void sphere_intersection(ib_v3 *r0, ib_v3 *rd, sphere_set *spheres, int index, float *t);
+void sphere_offset_intersection(ib_v3 *offset, ib_v3 *rd, float radius2, float *t);
+void plane_intersection(ib_v3 *r0, ib_v3 *rd, plane_set *planes, int index, float *t);
+void plane_offset_intersection(float offset, ib_v3 *rd, plane_set *planes, int index, float *t);
+void primary_ray(render_job *job, int x, int y, ib_v3 *rd);
+void tile_bounds(render_job *job, tile *cur_tile, tile_cone *cone);
+rgb shade_light(light *cur_light, material *mat, ib_v3 *ni, ib_v3 *rd, ib_v3 *rdn, float dist);
+bool shadowed(ib_v3 *ro, ib_v3 *rdn, float *dist, int *closest_index, scene *scn, int *blocker);
+float clamp(float value, float min, float max);
 
 #endif
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/mman.h>
+#include "ib_3dmath.h"
+#include "raycast.h"
+#include "scene.h"
+#include "bvh.h"
+
+// Forward declarations
+void alloc_spheres(sphere_set *spheres, int count);
+void alloc_planes(plane_set *planes, int count);
+float *alloc_floats(size_t count);
+
+// Method used to flatten the parsed object list into packed per-type arrays
+void compile_scene(scene *scn, linked_list *list)
+{
+   // Variable declarations
+   obj_node *cur_obj = list->first;
+   sphere_set unsorted;
+   material *sphere_mats;
+   int *order;
+   int sphere_count = 0;
+   int plane_count = 0;
+   int light_count = 0;
+   int index;
+
+   // Start with an empty scene
+   memset(scn, 0, sizeof(scene));
+   scn->cam_width = list->main_camera->obj_ref.width;
+   scn->cam_height = list->main_camera->obj_ref.height;
+
+   // Count each primitive type
+   for (index = 0; index < list->size; index++)
+   {
+      if (cur_obj->obj_ref.type == SPHERE)
+      {
+         sphere_count++;
+      }
+      else if (cur_obj->obj_ref.type == PLANE)
+      {
+         plane_count++;
+      }
+      else if (cur_obj->obj_ref.type == LIGHT)
+      {
+         light_count++;
+      }
+      cur_obj = cur_obj->next;
+   }
+
+   // Allocate hot and cold storage
+   alloc_spheres(&unsorted, sphere_count);
+   alloc_planes(&(scn->planes), plane_count);
+   sphere_mats = malloc(sizeof(material) * (sphere_count + 1));
+   scn->materials = malloc(sizeof(material) * (sphere_count + plane_count + 1));
+   scn->lights = malloc(sizeof(light) * (light_count + 1));
+   unsorted.count = 0;
+   scn->planes.count = 0;
+
+   // Copy the intersection data and material of every primitive
+   cur_obj = list->first;
+   for (index = 0; index < list->size; index++)
+   {
+      obj *cur = &(cur_obj->obj_ref);
+      material mat = { cur->diffuse_color, cur->specular_color, cur->reflectivity, cur->refractivity, cur->ior,
+                       1 - cur->reflectivity - cur->refractivity };
+
+      if (cur->type == SPHERE)
+      {
+         unsorted.x[unsorted.count] = cur->position.x;
+         unsorted.y[unsorted.count] = cur->position.y;
+         unsorted.z[unsorted.count] = cur->position.z;
+         unsorted.radius2[unsorted.count] = cur->radius * cur->radius;
+         sphere_mats[unsorted.count] = mat;
+         unsorted.count++;
+      }
+      else if (cur->type == PLANE)
+      {
+         plane_set *planes = &(scn->planes);
+         ib_v3 normal = cur->normal;
+
+         // Intersect with a unit normal, which leaves t unchanged, and shade
+         // with the normal as given, as the original did
+         ib_v3_normalize(&normal);
+         planes->nx[planes->count] = normal.x;
+         planes->ny[planes->count] = normal.y;
+         planes->nz[planes->count] = normal.z;
+         planes->d[planes->count] = -(normal.x * cur->position.x + normal.y * cur->position.y + normal.z * cur->position.z);
+         planes->sx[planes->count] = cur->normal.x;
+         planes->sy[planes->count] = cur->normal.y;
+         planes->sz[planes->count] = cur->normal.z;
+         scn->materials[sphere_count + planes->count] = mat;
+         planes->count++;
+      }
+      else if (cur->type == LIGHT)
+      {
+         light *cur_light = &(scn->lights[scn->light_count]);
+
+         // Copy the falloff terms
+         memset(cur_light, 0, sizeof(light));
+         cur_light->position = cur->position;
+         cur_light->color = cur->color;
+         cur_light->radial_a0 = cur->radial_a0;
+         cur_light->radial_a1 = cur->radial_a1;
+         cur_light->radial_a2 = cur->radial_a2;
+         cur_light->angular_a0 = cur->angular_a0;
+
+         // Lights without a cone angle or angular falloff are point lights
+         cur_light->spot = !(cur->theta == 0 || cur->angular_a0 == 0);
+         if (cur_light->spot == TRUE)
+         {
+            cur_light->direction = cur->direction;
+            ib_v3_normalize(&(cur_light->direction));
+            cur_light->cos_theta = cos(cur->theta * 3.14159265 / 180.0);
+         }
+         scn->light_count++;
+      }
+      cur_obj = cur_obj->next;
+   }
+
+   // Build the bvh, then store the spheres in leaf order
+   order = malloc(sizeof(int) * (sphere_count + 1));
+   build_bvh(&(scn->tree), &unsorted, order);
+   alloc_spheres(&(scn->spheres), sphere_count);
+   for (index = 0; index < sphere_count; index++)
+   {
+      scn->spheres.x[index] = unsorted.x[order[index]];
+      scn->spheres.y[index] = unsorted.y[order[index]];
+      scn->spheres.z[index] = unsorted.z[order[index]];
+      scn->spheres.radius2[index] = unsorted.radius2[order[index]];
+      scn->materials[index] = sphere_mats[order[index]];
+   }
+
+   // Release build data
+   free(unsorted.x);
+   free(sphere_mats);
+   free(order);
+}
+
+// Helper method used to release a compiled scene
+void free_scene(scene *scn)
+{
+   // A loaded scene only owns its mapping
+   if (scn->mapping != NULL)
+   {
+      munmap(scn->mapping, scn->mapping_size);
+      memset(scn, 0, sizeof(scene));
+      return;
+   }
+
+   free(scn->spheres.x);
+   free(scn->planes.nx);
+   free(scn->materials);
+   free(scn->lights);
+   free_bvh(&(scn->tree));
+   memset(scn, 0, sizeof(scene));
+}
+
+// Method used to work out the origin terms shared by every ray a frame traces
+// from one point, so primary intersection only does work that depends on direction
+void prepare_frame(frame_terms *frame, scene *scn, ib_v3 *origin)
+{
+   // Variable declarations
+   int sphere_stride = padded_count(scn->spheres.count);
+   int plane_stride = padded_count(scn->planes.count);
+   float *block = alloc_floats(3 * sphere_stride + plane_stride);
+   plane_set *planes = &(scn->planes);
+
+   // Padding never hits anything
+   for (int index = 0; index < 3 * sphere_stride + plane_stride; index++)
+   {
+      block[index] = NAN;
+   }
+
+   // Split block into one array per term
+   frame->origin = *origin;
+   frame->ox = block;
+   frame->oy = block + sphere_stride;
+   frame->oz = block + 2 * sphere_stride;
+   frame->plane_offset = block + 3 * sphere_stride;
+
+   // Offset from each sphere center to the origin, as sphere_intersection finds it
+   for (int index = 0; index < scn->spheres.count; index++)
+   {
+      frame->ox[index] = origin->x - scn->spheres.x[index];
+      frame->oy[index] = origin->y - scn->spheres.y[index];
+      frame->oz[index] = origin->z - scn->spheres.z[index];
+   }
+
+   // Distance term of each plane, as plane_intersection finds it
+   for (int index = 0; index < planes->count; index++)
+   {
+      frame->plane_offset[index] = planes->nx[index] * origin->x + planes->ny[index] * origin->y +
+                                   planes->nz[index] * origin->z + planes->d[index];
+   }
+}
+
+// Helper method used to release the terms of a frame
+void free_frame(frame_terms *frame)
+{
+   free(frame->ox);
+   memset(frame, 0, sizeof(frame_terms));
+}
+
+// Helper method used to find how many floats each primitive array holds, rounded
+// up and padded so a kernel can always load KERNEL_WIDTH values from any index
+int padded_count(int count)
+{
+   return (count + KERNEL_WIDTH - 1) / KERNEL_WIDTH * KERNEL_WIDTH + KERNEL_WIDTH;
+}
+
+// Helper method used to allocate count floats aligned for the kernels. The size
+// aligned_alloc is given must be a multiple of the alignment, so it is rounded up.
+float *alloc_floats(size_t count)
+{
+   // Variable declarations
+   size_t size = (sizeof(float) * count + KERNEL_ALIGN - 1) / KERNEL_ALIGN * KERNEL_ALIGN;
+
+   return aligned_alloc(KERNEL_ALIGN, size);
+}
+
+// Helper method used to allocate sphere arrays as one block
+void alloc_spheres(sphere_set *spheres, int count)
+{
+   // Variable declarations
+   int stride = padded_count(count);
+   float *block = alloc_floats(4 * stride);
+
+   // Padding never hits anything
+   for (int index = 0; index < 4 * stride; index++)
+   {
+      block[index] = NAN;
+   }
+
+   // Split block into one array per component
+   spheres->x = block;
+   spheres->y = block + stride;
+   spheres->z = block + 2 * stride;
+   spheres->radius2 = block + 3 * stride;
+   spheres->count = count;
+}
+
+// Helper method used to allocate plane arrays as one block
+void alloc_planes(plane_set *planes, int count)
+{
+   // Variable declarations
+   int stride = padded_count(count);
+   float *block = alloc_floats(7 * stride);
+
+   // Padding never hits anything
+   for (int index = 0; index < 7 * stride; index++)
+   {
+      block[index] = NAN;
+   }
+
+   // Split block into one array per component
+   planes->nx = block;
+   planes->ny = block + stride;
+   planes->nz = block + 2 * stride;
+   planes->d = block + 3 * stride;
+   planes->sx = block + 4 * stride;
+   planes->sy = block + 5 * stride;
+   planes->sz = block + 6 * stride;
+   planes->count = count;
+}
@@ -0,0 +1,13 @@
+#ifndef SCENE
+#define SCENE
+
+#include "raycast.h"
+
+// Public function declarations
+void compile_scene(scene *scn, linked_list *list);
+void free_scene(scene *scn);
+int padded_count(int count);
+void prepare_frame(frame_terms *frame, scene *scn, ib_v3 *origin);
+void free_frame(frame_terms *frame);
+
+#endif
@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "ib_3dmath.h"
+#include "raycast.h"
+#include "parser.h"
+#include "scene.h"
+#include "scenefile.h"
+#include "bvh.h"
+
+// Forward declarations
+void section_sizes(scene_header *header, uint64_t *sizes);
+bool check_header(scene_header *header, uint64_t file_size);
+bool check_nodes(scene *scn);
+void write_parts(int out_file, struct iovec *parts, int part_count, int *result);
+
+// Method used to check whether a file starts with the compiled scene magic
+bool is_scene_file(char *file_name)
+{
+   // Variable declarations
+   char magic[SCENE_MAGIC_LEN];
+   int file = open(file_name, O_RDONLY);
+   bool found;
+
+   // Files that cannot be opened are left for the text parser to report
+   if (file < 0)
+   {
+      return FALSE;
+   }
+
+   // Compare the first bytes, including the terminator
+   found = read(file, magic, SCENE_MAGIC_LEN) == SCENE_MAGIC_LEN && memcmp(magic, SCENE_MAGIC, SCENE_MAGIC_LEN) == 0;
+   close(file);
+
+   return found;
+}
+
+// Method used to write a compiled scene, bvh included, so it can be mapped back without parsing
+void save_scene(scene *scn, char *file_name, int *result)
+{
+   // Variable declarations
+   static const char padding[SCENE_ALIGN];
+   scene_header header;
+   uint64_t sizes[SCENE_SECTIONS];
+   struct iovec parts[2 * SCENE_SECTIONS + 1];
+   int part_count = 0;
+   uint64_t offset;
+   int out_file;
+   int index;
+   void *bases[SCENE_SECTIONS] =
+   {
+      scn->spheres.x, scn->spheres.y, scn->spheres.z, scn->spheres.radius2,
+      scn->planes.nx, scn->planes.ny, scn->planes.nz, scn->planes.d,
+      scn->planes.sx, scn->planes.sy, scn->planes.sz,
+      scn->materials, scn->lights, scn->tree.nodes
+   };
+
+   // Describe the scene and the layout of its records
+   memset(&header, 0, sizeof(scene_header));
+   memcpy(header.magic, SCENE_MAGIC, SCENE_MAGIC_LEN);
+   header.version = SCENE_VERSION;
+   header.byte_order = SCENE_BYTE_ORDER;
+   header.material_size = sizeof(material);
+   header.light_size = sizeof(light);
+   header.node_size = sizeof(bvh_node);
+   header.sphere_count = scn->spheres.count;
+   header.plane_count = scn->planes.count;
+   header.light_count = scn->light_count;
+   header.node_count = scn->tree.node_count;
+   header.cam_width = scn->cam_width;
+   header.cam_height = scn->cam_height;
+   section_sizes(&header, sizes);
+
+   // Lay every section out after the header, each one aligned
+   parts[part_count].iov_base = &header;
+   parts[part_count++].iov_len = sizeof(scene_header);
+   offset = sizeof(scene_header);
+   for (index = 0; index < SCENE_SECTIONS; index++)
+   {
+      // Pad up to the next boundary
+      if (offset % SCENE_ALIGN != 0)
+      {
+         parts[part_count].iov_base = (void *)padding;
+         parts[part_count++].iov_len = SCENE_ALIGN - offset % SCENE_ALIGN;
+         offset += SCENE_ALIGN - offset % SCENE_ALIGN;
+      }
+
+      // Add the section itself
+      header.offsets[index] = offset;
+      if (sizes[index] > 0)
+      {
+         parts[part_count].iov_base = bases[index];
+         parts[part_count++].iov_len = sizes[index];
+         offset += sizes[index];
+      }
+   }
+   header.file_size = offset;
+
+   // Start by opening file
+   if ((out_file = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+   {
+      *result = OUTPUT_INVALID;
+      return;
+   }
+
+   // Write everything, then close file
+   write_parts(out_file, parts, part_count, result);
+   if (close(out_file) != 0)
+   {
+      *result = OUTPUT_INVALID;
+   }
+}
+
+// Method used to map a compiled scene file and point the scene arrays straight into it
+void load_scene(scene *scn, char *file_name, int *result)
+{
+   // Variable declarations
+   int file;
+   struct stat info;
+   char *data;
+   scene_header *header;
+
+   // Start with an empty scene
+   memset(scn, 0, sizeof(scene));
+
+   // Check that the file exists and is big enough to hold a header
+   file = open(file_name, O_RDONLY);
+   if (file < 0 || fstat(file, &info) != 0 || (uint64_t)info.st_size < sizeof(scene_header))
+   {
+      *result = INPUT_INVALID;
+      if (file >= 0)
+      {
+         close(file);
+      }
+      return;
+   }
+
+   // Map the whole file; the renderer only ever reads the scene
+   data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, file, 0);
+   close(file);
+   if (data == MAP_FAILED)
+   {
+      *result = INPUT_INVALID;
+      return;
+   }
+   scn->mapping = data;
+   scn->mapping_size = info.st_size;
+
+   // Refuse files from another version, machine or build
+   header = (scene_header *)data;
+   if (check_header(header, info.st_size) == FALSE)
+   {
+      munmap(data, info.st_size);
+      memset(scn, 0, sizeof(scene));
+      *result = INPUT_INVALID;
+      return;
+   }
+
+   // Point every array into the mapping
+   scn->spheres.x = (float *)(data + header->offsets[SECTION_SPHERE_X]);
+   scn->spheres.y = (float *)(data + header->offsets[SECTION_SPHERE_Y]);
+   scn->spheres.z = (float *)(data + header->offsets[SECTION_SPHERE_Z]);
+   scn->spheres.radius2 = (float *)(data + header->offsets[SECTION_SPHERE_RADIUS2]);
+   scn->spheres.count = header->sphere_count;
+   scn->planes.nx = (float *)(data + header->offsets[SECTION_PLANE_NX]);
+   scn->planes.ny = (float *)(data + header->offsets[SECTION_PLANE_NY]);
+   scn->planes.nz = (float *)(data + header->offsets[SECTION_PLANE_NZ]);
+   scn->planes.d = (float *)(data + header->offsets[SECTION_PLANE_D]);
+   scn->planes.sx = (float *)(data + header->offsets[SECTION_PLANE_SX]);
+   scn->planes.sy = (float *)(data + header->offsets[SECTION_PLANE_SY]);
+   scn->planes.sz = (float *)(data + header->offsets[SECTION_PLANE_SZ]);
+   scn->planes.count = header->plane_count;
+   scn->materials = (material *)(data + header->offsets[SECTION_MATERIALS]);
+   scn->lights = (light *)(data + header->offsets[SECTION_LIGHTS]);
+   scn->light_count = header->light_count;
+   scn->tree.nodes = header->node_count > 0 ? (bvh_node *)(data + header->offsets[SECTION_NODES]) : NULL;
+   scn->tree.node_count = header->node_count;
+   scn->cam_width = header->cam_width;
+   scn->cam_height = header->cam_height;
+
+   // Make sure traversal cannot leave the arrays
+   if (check_nodes(scn) == FALSE)
+   {
+      munmap(data, info.st_size);
+      memset(scn, 0, sizeof(scene));
+      *result = INPUT_INVALID;
+      return;
+   }
+
+   *result = RUN_SUCCESS;
+}
+
+// Helper method used to find the size of each section from the counts in a header.
+// Primitive arrays are stored with their kernel padding.
+void section_sizes(scene_header *header, uint64_t *sizes)
+{
+   sizes[SECTION_SPHERE_X] = sizeof(float) * (uint64_t)padded_count(header->sphere_count);
+   sizes[SECTION_SPHERE_Y] = sizes[SECTION_SPHERE_X];
+   sizes[SECTION_SPHERE_Z] = sizes[SECTION_SPHERE_X];
+   sizes[SECTION_SPHERE_RADIUS2] = sizes[SECTION_SPHERE_X];
+   sizes[SECTION_PLANE_NX] = sizeof(float) * (uint64_t)padded_count(header->plane_count);
+   sizes[SECTION_PLANE_NY] = sizes[SECTION_PLANE_NX];
+   sizes[SECTION_PLANE_NZ] = sizes[SECTION_PLANE_NX];
+   sizes[SECTION_PLANE_D] = sizes[SECTION_PLANE_NX];
+   sizes[SECTION_PLANE_SX] = sizes[SECTION_PLANE_NX];
+   sizes[SECTION_PLANE_SY] = sizes[SECTION_PLANE_NX];
+   sizes[SECTION_PLANE_SZ] = sizes[SECTION_PLANE_NX];
+   sizes[SECTION_MATERIALS] = sizeof(material) * ((uint64_t)header->sphere_count + header->plane_count);
+   sizes[SECTION_LIGHTS] = sizeof(light) * (uint64_t)header->light_count;
+   sizes[SECTION_NODES] = sizeof(bvh_node) * (uint64_t)header->node_count;
+}
+
+// Helper method used to validate a header against this build and the size of its file
+bool check_header(scene_header *header, uint64_t file_size)
+{
+   // Variable declarations
+   uint64_t sizes[SCENE_SECTIONS];
+   int index;
+
+   // Identity, version and record layout must all match
+   if (memcmp(header->magic, SCENE_MAGIC, SCENE_MAGIC_LEN) != 0 || header->version != SCENE_VERSION ||
+       header->byte_order != SCENE_BYTE_ORDER || header->material_size != sizeof(material) ||
+       header->light_size != sizeof(light) || header->node_size != sizeof(bvh_node) ||
+       header->file_size != file_size)
+   {
+      return FALSE;
+   }
+
+   // Counts must be sane; a bvh never has more than 2n - 1 nodes
+   if (header->sphere_count < 0 || header->plane_count < 0 || header->light_count < 0 ||
+       header->sphere_count > INT_MAX / 2 || header->plane_count > INT_MAX / 2 ||
+       header->node_count < 0 || header->node_count > 2 * (int64_t)header->sphere_count)
+   {
+      return FALSE;
+   }
+
+   // Every section must be aligned and inside the file
+   section_sizes(header, sizes);
+   for (index = 0; index < SCENE_SECTIONS; index++)
+   {
+      if (header->offsets[index] % SCENE_ALIGN != 0 || header->offsets[index] > file_size ||
+          sizes[index] > file_size - header->offsets[index])
+      {
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+// Helper method used to check that leaves stay inside the sphere arrays, that
+// children always come after their parent, so traversal terminates, and that
+// no path is deep enough to overflow the traversal stacks. Splitting a node at
+// depth n leaves at most n waiting siblings and its two children on a stack.
+bool check_nodes(scene *scn)
+{
+   // Variable declarations
+   bvh_node *node;
+   int *depths;
+   int index;
+   bool valid = TRUE;
+
+   // Children come later in the array, so depths fill in a single pass
+   depths = calloc(scn->tree.node_count > 0 ? scn->tree.node_count : 1, sizeof(int));
+   if (depths == NULL)
+   {
+      return FALSE;
+   }
+
+   for (index = 0; index < scn->tree.node_count && valid == TRUE; index++)
+   {
+      node = &(scn->tree.nodes[index]);
+
+      // Leaves cover a range of spheres, interior nodes point at two adjacent children
+      if (node->count > 0)
+      {
+         valid = node->left_first >= 0 && node->left_first <= scn->spheres.count - node->count;
+      }
+      else if (node->count < 0 || node->left_first <= index || node->left_first >= scn->tree.node_count - 1 ||
+               depths[index] + 1 >= BVH_STACK_SIZE)
+      {
+         valid = FALSE;
+      }
+      // A node reached along several paths keeps the deepest of them
+      else
+      {
+         for (int child = node->left_first; child <= node->left_first + 1; child++)
+         {
+            if (depths[child] < depths[index] + 1)
+            {
+               depths[child] = depths[index] + 1;
+            }
+         }
+      }
+   }
+
+   free(depths);
+   return valid;
+}
+
+// Helper method used to write a list of buffers, continuing after short writes
+void write_parts(int out_file, struct iovec *parts, int part_count, int *result)
+{
+   // Variable declarations
+   int first = 0;
+
+   *result = RUN_SUCCESS;
+
+   // Keep writing until the kernel has taken everything
+   while (first < part_count)
+   {
+      // Variable declarations
+      ssize_t written = writev(out_file, parts + first, part_count - first);
+
+      // Stop on a real error
+      if (written < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         *result = OUTPUT_INVALID;
+         return;
+      }
+
+      // Skip over whatever part of the buffers was written
+      while (first < part_count && (size_t)written >= parts[first].iov_len)
+      {
+         written -= parts[first].iov_len;
+         first++;
+      }
+      if (first < part_count)
+      {
+         parts[first].iov_base = (char *)parts[first].iov_base + written;
+         parts[first].iov_len -= written;
+      }
+   }
+}
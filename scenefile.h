@@ -0,0 +1,35 @@
+#ifndef SCENEFILE
+#define SCENEFILE
+
+#include "raycast.h"
+
+#define SCENE_MAGIC "RTSCENE"
+#define SCENE_MAGIC_LEN 8
+#define SCENE_VERSION 5
+#define SCENE_BYTE_ORDER 0x01020304
+#define SCENE_ALIGN 64
+
+#define COMPILE_OPTION "--compile"
+#define COMPILE_ARGS 4
+
+#define SECTION_SPHERE_X 0
+#define SECTION_SPHERE_Y 1
+#define SECTION_SPHERE_Z 2
+#define SECTION_SPHERE_RADIUS2 3
+#define SECTION_PLANE_NX 4
+#define SECTION_PLANE_NY 5
+#define SECTION_PLANE_NZ 6
+#define SECTION_PLANE_D 7
+#define SECTION_PLANE_SX 8
+#define SECTION_PLANE_SY 9
+#define SECTION_PLANE_SZ 10
+#define SECTION_MATERIALS 11
+#define SECTION_LIGHTS 12
+#define SECTION_NODES 13
+
+// Public function declarations
+bool is_scene_file(char *file_name);
+void save_scene(scene *scn, char *file_name, int *result);
+void load_scene(scene *scn, char *file_name, int *result);
+
+#endif
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "raycast.h"
+#include "stats.h"
+
+// Forward declarations
+void report_text(bool loaded, double *phases, render_stats *totals);
+void report_json(bool loaded, double *phases, render_stats *totals);
+
+#if STATS_COUNTERS
+// Counters of the calling thread, added to the render totals when it finishes
+_Thread_local render_stats thread_stats;
+
+// Lock held while a thread adds its counters to the totals
+static pthread_mutex_t merge_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+// Method used to clear the calling thread's counters before it starts rendering
+void reset_stats()
+{
+#if STATS_COUNTERS
+   memset(&thread_stats, 0, sizeof(render_stats));
+#endif
+}
+
+// Method used to add the calling thread's counters to the render totals
+void merge_stats(render_stats *totals)
+{
+#if STATS_COUNTERS
+   pthread_mutex_lock(&merge_lock);
+   totals->primary_rays += thread_stats.primary_rays;
+   totals->secondary_rays += thread_stats.secondary_rays;
+   totals->shadow_rays += thread_stats.shadow_rays;
+   totals->pruned_rays += thread_stats.pruned_rays;
+   totals->sphere_tests += thread_stats.sphere_tests;
+   totals->plane_tests += thread_stats.plane_tests;
+   totals->box_tests += thread_stats.box_tests;
+   totals->cache_tests += thread_stats.cache_tests;
+   totals->cache_hits += thread_stats.cache_hits;
+   totals->secondary_time += thread_stats.secondary_time;
+   for (int depth = 0; depth <= MAX_DEPTH_LIMIT; depth++)
+   {
+      totals->depth_rays[depth] += thread_stats.depth_rays[depth];
+   }
+   pthread_mutex_unlock(&merge_lock);
+#endif
+}
+
+// Method used to print the phase timings and counters of a run to stderr in the
+// format the options asked for
+void report_stats(options *opts, bool loaded, double *phases, render_stats *totals)
+{
+   if (opts->stats == STATS_TEXT)
+   {
+      report_text(loaded, phases, totals);
+   }
+   else if (opts->stats == STATS_JSON)
+   {
+      report_json(loaded, phases, totals);
+   }
+}
+
+// Helper method used to print the report as lines of text
+void report_text(bool loaded, double *phases, render_stats *totals)
+{
+   // Phase timings are always available
+   fprintf(stderr, "%s: %.3f ms\n", loaded == TRUE ? "load" : "parse", phases[PHASE_PARSE] * 1000.0);
+   fprintf(stderr, "preprocess: %.3f ms\n", phases[PHASE_PREPROCESS] * 1000.0);
+   fprintf(stderr, "render: %.3f ms\n", phases[PHASE_RENDER] * 1000.0);
+   fprintf(stderr, "write: %.3f ms\n", phases[PHASE_WRITE] * 1000.0);
+
+#if STATS_COUNTERS
+   // Then the counters, summed over every render thread
+   fprintf(stderr, "rays: %ld primary, %ld secondary, %ld shadow, %ld pruned\n",
+           totals->primary_rays, totals->secondary_rays, totals->shadow_rays, totals->pruned_rays);
+   fprintf(stderr, "tests: %ld sphere, %ld plane, %ld box\n", totals->sphere_tests, totals->plane_tests, totals->box_tests);
+   fprintf(stderr, "depth:");
+   for (int depth = 0; depth <= MAX_DEPTH_LIMIT && totals->depth_rays[depth] > 0; depth++)
+   {
+      fprintf(stderr, " %d:%ld", depth, totals->depth_rays[depth]);
+   }
+   fprintf(stderr, "\n");
+   fprintf(stderr, "occluder cache: %ld of %ld hits (%.1f%%)\n", totals->cache_hits, totals->cache_tests,
+           totals->cache_tests > 0 ? 100.0 * totals->cache_hits / totals->cache_tests : 0.0);
+   fprintf(stderr, "secondary rays: %ld in %.3f ms, %.2f Mrays/s per thread\n", totals->secondary_rays, totals->secondary_time * 1000.0,
+           totals->secondary_time > 0 ? totals->secondary_rays / totals->secondary_time / 1e6 : 0.0);
+#else
+   fprintf(stderr, "counters: not built in\n");
+#endif
+}
+
+// Helper method used to print the report as a single JSON object
+void report_json(bool loaded, double *phases, render_stats *totals)
+{
+   // Phase timings are always available
+   fprintf(stderr, "{\n");
+   fprintf(stderr, "  \"loaded\": %s,\n", loaded == TRUE ? "true" : "false");
+   fprintf(stderr, "  \"threads\": %d,\n", totals->workers);
+   fprintf(stderr, "  \"phases_ms\": { \"parse\": %.3f, \"preprocess\": %.3f, \"render\": %.3f, \"write\": %.3f },\n",
+           phases[PHASE_PARSE] * 1000.0, phases[PHASE_PREPROCESS] * 1000.0, phases[PHASE_RENDER] * 1000.0, phases[PHASE_WRITE] * 1000.0);
+
+#if STATS_COUNTERS
+   // Then the counters, summed over every render thread
+   fprintf(stderr, "  \"counters\": {\n");
+   fprintf(stderr, "    \"primary_rays\": %ld,\n", totals->primary_rays);
+   fprintf(stderr, "    \"secondary_rays\": %ld,\n", totals->secondary_rays);
+   fprintf(stderr, "    \"shadow_rays\": %ld,\n", totals->shadow_rays);
+   fprintf(stderr, "    \"pruned_rays\": %ld,\n", totals->pruned_rays);
+   fprintf(stderr, "    \"sphere_tests\": %ld,\n", totals->sphere_tests);
+   fprintf(stderr, "    \"plane_tests\": %ld,\n", totals->plane_tests);
+   fprintf(stderr, "    \"box_tests\": %ld,\n", totals->box_tests);
+   fprintf(stderr, "    \"occluder_cache_tests\": %ld,\n", totals->cache_tests);
+   fprintf(stderr, "    \"occluder_cache_hits\": %ld,\n", totals->cache_hits);
+   fprintf(stderr, "    \"secondary_ms\": %.3f,\n", totals->secondary_time * 1000.0);
+   fprintf(stderr, "    \"depth_rays\": [");
+   for (int depth = 0; depth <= MAX_DEPTH_LIMIT && totals->depth_rays[depth] > 0; depth++)
+   {
+      fprintf(stderr, "%s%ld", depth > 0 ? ", " : "", totals->depth_rays[depth]);
+   }
+   fprintf(stderr, "]\n");
+   fprintf(stderr, "  }\n");
+#else
+   fprintf(stderr, "  \"counters\": null\n");
+#endif
+   fprintf(stderr, "}\n");
+}
@@ -0,0 +1,31 @@
+#ifndef RENDER_STATS
+#define RENDER_STATS
+
+#include "raycast.h"
+
+// Counters are built in unless the build turns them off, as make release does
+#ifndef STATS_COUNTERS
+#define STATS_COUNTERS 1
+#endif
+
+#define PHASE_PARSE 0
+#define PHASE_PREPROCESS 1
+#define PHASE_RENDER 2
+#define PHASE_WRITE 3
+#define PHASE_COUNT 4
+
+// Hot-path counters go through STAT_ADD, which adds to the calling thread's own
+// counters and compiles to nothing when counters are off
+#if STATS_COUNTERS
+#define STAT_ADD(field, amount) (thread_stats.field += (amount))
+extern _Thread_local render_stats thread_stats;
+#else
+#define STAT_ADD(field, amount) ((void)0)
+#endif
+
+// Public function declarations
+void reset_stats();
+void merge_stats(render_stats *totals);
+void report_stats(options *opts, bool loaded, double *phases, render_stats *totals);
+
+#endif
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "raycast.h"
+#include "tiles.h"
+#include "wavefront.h"
+#include "stats.h"
+
+// Type definitions
+typedef struct worker_args worker_args;
+
+// Arguments handed to each render thread
+struct worker_args
+{
+   worker self;
+   void (*render_tile)(worker *self, tile *cur_tile);
+};
+
+// Forward declarations
+void *worker_main(void *data);
+bool deque_pop(tile_deque *deque, int *item);
+bool deque_steal(tile_deque *deque, int *item, bool *empty);
+
+// Method used to split the image into tiles and render them on a pool of threads
+void run_tiles(render_job *job, void (*render_tile)(worker *self, tile *cur_tile))
+{
+   // Variable declarations
+   int tile_size = job->opts->tile_size;
+   int tiles_x = (job->width + tile_size - 1) / tile_size;
+   int tiles_y = (job->height + tile_size - 1) / tile_size;
+   int *items;
+   pthread_t *threads;
+   worker_args *args;
+   int index;
+
+   // Never start more workers than there are tiles
+   job->tile_count = tiles_x * tiles_y;
+   job->worker_count = job->opts->threads;
+   if (job->worker_count > job->tile_count)
+   {
+      job->worker_count = job->tile_count;
+   }
+
+   // Create tiles in scanline order
+   job->tiles = malloc(sizeof(tile) * job->tile_count);
+   items = malloc(sizeof(int) * job->tile_count);
+   for (index = 0; index < job->tile_count; index++)
+   {
+      tile *cur_tile = &(job->tiles[index]);
+
+      cur_tile->x0 = (index % tiles_x) * tile_size;
+      cur_tile->y0 = (index / tiles_x) * tile_size;
+      cur_tile->x1 = cur_tile->x0 + tile_size < job->width ? cur_tile->x0 + tile_size : job->width;
+      cur_tile->y1 = cur_tile->y0 + tile_size < job->height ? cur_tile->y0 + tile_size : job->height;
+      items[index] = index;
+   }
+
+   // Give each worker a contiguous band of tiles to start with
+   job->deques = malloc(sizeof(tile_deque) * job->worker_count);
+   for (index = 0; index < job->worker_count; index++)
+   {
+      long first = (long)job->tile_count * index / job->worker_count;
+      long last = (long)job->tile_count * (index + 1) / job->worker_count;
+
+      job->deques[index].items = items + first;
+      atomic_init(&(job->deques[index].top), 0);
+      atomic_init(&(job->deques[index].bottom), last - first);
+   }
+
+   // Start the workers, using the calling thread as worker 0
+   threads = malloc(sizeof(pthread_t) * job->worker_count);
+   args = malloc(sizeof(worker_args) * job->worker_count);
+   for (index = 0; index < job->worker_count; index++)
+   {
+      args[index].self.id = index;
+      args[index].self.job = job;
+      memset(&(args[index].self.wave), 0, sizeof(wavefront));
+      args[index].render_tile = render_tile;
+   }
+   for (index = 1; index < job->worker_count; index++)
+   {
+      pthread_create(&threads[index], NULL, worker_main, &args[index]);
+   }
+   worker_main(&args[0]);
+
+   // Wait for every worker to run out of work
+   for (index = 1; index < job->worker_count; index++)
+   {
+      pthread_join(threads[index], NULL);
+   }
+
+   // Release the queues each worker kept between tiles
+   for (index = 0; index < job->worker_count; index++)
+   {
+      free_wavefront(&(args[index].self.wave));
+   }
+
+   // Release scheduling data
+   free(threads);
+   free(args);
+   free(items);
+   free(job->deques);
+   free(job->tiles);
+   job->deques = NULL;
+   job->tiles = NULL;
+}
+
+// Helper method used to return the number of online processors
+int default_thread_count()
+{
+   // Variable declarations
+   long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+   return count > 0 ? (int)count : 1;
+}
+
+// Helper method used as the body of each render thread
+void *worker_main(void *data)
+{
+   // Variable declarations
+   worker_args *args = data;
+   worker *self = &(args->self);
+   render_job *job = self->job;
+   int item;
+   bool empty;
+   bool all_empty = FALSE;
+
+   // Count this render's work from zero
+   reset_stats();
+
+   // Keep working until every deque is empty
+   while (all_empty == FALSE)
+   {
+      // Render our own tiles first
+      while (deque_pop(&(job->deques[self->id]), &item) == TRUE)
+      {
+         args->render_tile(self, &(job->tiles[item]));
+      }
+
+      // Then try to steal from the other workers, starting with our neighbour
+      all_empty = TRUE;
+      for (int offset = 1; offset < job->worker_count; offset++)
+      {
+         int victim = (self->id + offset) % job->worker_count;
+
+         if (deque_steal(&(job->deques[victim]), &item, &empty) == TRUE)
+         {
+            args->render_tile(self, &(job->tiles[item]));
+            all_empty = FALSE;
+            break;
+         }
+
+         // A lost race means the victim may still have work
+         if (empty == FALSE)
+         {
+            all_empty = FALSE;
+         }
+      }
+   }
+
+   // Add what this thread counted to the render totals
+   merge_stats(job->stats);
+   return NULL;
+}
+
+// Helper method used by the owner to take the most recently added tile
+bool deque_pop(tile_deque *deque, int *item)
+{
+   // Variable declarations
+   long bottom = atomic_load(&(deque->bottom)) - 1;
+   long top;
+   bool taken = TRUE;
+
+   // Reserve the bottom item before looking at the top
+   atomic_store(&(deque->bottom), bottom);
+   top = atomic_load(&(deque->top));
+
+   // Deque was already empty
+   if (top > bottom)
+   {
+      atomic_store(&(deque->bottom), bottom + 1);
+      return FALSE;
+   }
+
+   // Take the item, racing thieves if it is the last one
+   *item = deque->items[bottom];
+   if (top == bottom)
+   {
+      taken = atomic_compare_exchange_strong(&(deque->top), &top, top + 1);
+      atomic_store(&(deque->bottom), bottom + 1);
+   }
+
+   return taken;
+}
+
+// Helper method used by other workers to take the oldest tile
+bool deque_steal(tile_deque *deque, int *item, bool *empty)
+{
+   // Variable declarations
+   long top = atomic_load(&(deque->top));
+   long bottom = atomic_load(&(deque->bottom));
+
+   // Nothing left to steal
+   *empty = top >= bottom;
+   if (*empty == TRUE)
+   {
+      return FALSE;
+   }
+
+   // Read the item, then claim it unless another thread got there first
+   *item = deque->items[top];
+   return atomic_compare_exchange_strong(&(deque->top), &top, top + 1);
+}
@@ -0,0 +1,12 @@
+#ifndef TILES
+#define TILES
+
+#include "raycast.h"
+
+#define TILE_SIZE_DEFAULT 32
+
+// Public function declarations
+void run_tiles(render_job *job, void (*render_tile)(worker *self, tile *cur_tile));
+int default_thread_count();
+
+#endif
@@ -0,0 +1,18 @@
+// Ensure program is only compiled once
+#ifndef IB_TIMER
+#define IB_TIMER
+
+#include <time.h>
+
+// Function used to return a monotonic timestamp in seconds
+static inline double ib_now()
+{
+   // Variable declarations
+   struct timespec now;
+
+   // Read the monotonic clock so timings are not affected by clock changes
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+#endif
@@ -0,0 +1,932 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <x86intrin.h>
+#include "ib_3dmath.h"
+#include "raycast.h"
+#include "bvh.h"
+#include "packet.h"
+#include "framebuffer.h"
+#include "timer.h"
+#include "stats.h"
+#include "intersect.h"
+#include "wavefront.h"
+
+// Forward declarations
+void grow_rays(ray_queue *queue, int capacity);
+void grow_shadows(shadow_queue *queue, int capacity);
+void push_ray(ray_queue *queue, ib_v3 *r0, ib_v3 *rd, float weight, float budget, int pixel);
+void generate_rays(render_job *job, wavefront *wave, tile *cur_tile);
+void extend_rays(render_job *job, wavefront *wave, ray_queue *queue, tile *cur_tile, int depth);
+void extend_packets(render_job *job, wavefront *wave, ray_queue *queue);
+void keep_hits(scene *scn, ray_queue *queue);
+void cast_shadows(render_job *job, wavefront *wave, ray_queue *queue);
+void test_shadow(scene *scn, wavefront *wave, ray_queue *queue, int ray, int cur_light);
+void sort_rays(render_job *job, wavefront *wave, float *x, float *y, float *z, float *dx, float *dy, float *dz, int count);
+uint32_t spread_bits(uint32_t value);
+int compare_keys(const void *a, const void *b);
+void shade_rays(scene *scn, options *opts, wavefront *wave, ray_queue *queue);
+void spawn_rays(render_job *job, wavefront *wave, ray_queue *queue, ray_queue *next, int depth);
+bool prune_ray(render_job *job, wavefront *wave, float weight, float budget, int pixel, int depth);
+void charge_rays(wavefront *wave, ray_queue *queue, float amount);
+uint64_t heat_clock(render_job *job);
+void charge_cycles(render_job *job, wavefront *wave, int pixel, uint64_t start);
+
+// Method used by each render thread to trace one tile a generation of rays at a
+// time. Every stage works through the whole queue before the next one starts:
+// generate the primary rays, extend them to their closest hits, cast a shadow
+// ray per hit and light, shade, then spawn the reflection and refraction rays
+// that make up the next generation.
+void trace_tile(worker *self, tile *cur_tile)
+{
+   // Variable declarations
+   render_job *job = self->job;
+   wavefront *wave = &(self->wave);
+   int tile_width = cur_tile->x1 - cur_tile->x0;
+   int tile_height = cur_tile->y1 - cur_tile->y0;
+   int pixel_count = tile_width * tile_height;
+   ray_queue *queue = &(wave->rays[0]);
+   ray_queue *next = &(wave->rays[1]);
+   ray_queue *swap;
+#if STATS_COUNTERS
+   double start;
+#endif
+
+   // Start every pixel of the tile black, and free if a heatmap is kept
+   if (wave->color_capacity < pixel_count)
+   {
+      free(wave->colors);
+      free(wave->costs);
+      wave->colors = malloc(sizeof(rgb) * pixel_count);
+      wave->costs = malloc(sizeof(float) * pixel_count);
+      wave->color_capacity = pixel_count;
+   }
+   memset(wave->colors, 0, sizeof(rgb) * pixel_count);
+   if (job->heat != NULL)
+   {
+      memset(wave->costs, 0, sizeof(float) * pixel_count);
+   }
+
+   // One primary ray per pixel, then one generation per bounce
+   generate_rays(job, wave, cur_tile);
+   for (int depth = 0; depth <= job->opts->max_depth && queue->count > 0; depth++)
+   {
+      // Count the rays of each generation, and time the secondary ones,
+      // sorting included, to see what sorting buys
+      STAT_ADD(depth_rays[depth], queue->count);
+      STAT_ADD(primary_rays, depth == 0 ? queue->count : 0);
+      STAT_ADD(secondary_rays, depth > 0 ? queue->count : 0);
+      if (job->opts->heatmap == HEATMAP_RAYS)
+      {
+         charge_rays(wave, queue, 1);
+      }
+#if STATS_COUNTERS
+      start = ib_now();
+#endif
+      extend_rays(job, wave, queue, cur_tile, depth);
+#if STATS_COUNTERS
+      STAT_ADD(secondary_time, depth > 0 ? ib_now() - start : 0);
+#endif
+
+      // Every hit left casts a shadow ray per light
+      if (job->opts->heatmap == HEATMAP_RAYS)
+      {
+         charge_rays(wave, queue, job->scn->light_count);
+      }
+      cast_shadows(job, wave, queue);
+      shade_rays(job->scn, job->opts, wave, queue);
+
+      // Rays past the last bounce would add nothing
+      next->count = 0;
+      if (depth < job->opts->max_depth)
+      {
+         spawn_rays(job, wave, queue, next, depth);
+      }
+      swap = queue;
+      queue = next;
+      next = swap;
+   }
+
+   // Store the colors a row at a time so they are quantized together
+   for (int row = 0; row < tile_height; row++)
+   {
+      store_span(job->fb, cur_tile->x0, cur_tile->y0 + row, wave->colors + row * tile_width, tile_width);
+   }
+
+   // Copy what each pixel cost into the heatmap the same way
+   if (job->heat != NULL)
+   {
+      for (int row = 0; row < tile_height; row++)
+      {
+         memcpy(job->heat + (cur_tile->y0 + row) * job->width + cur_tile->x0, wave->costs + row * tile_width, sizeof(float) * tile_width);
+      }
+   }
+}
+
+// Method used to release the queues of a render thread
+void free_wavefront(wavefront *wave)
+{
+   // Variable declarations
+   ray_queue *queue;
+
+   for (int index = 0; index < 2; index++)
+   {
+      queue = &(wave->rays[index]);
+      free(queue->ox);
+      free(queue->oy);
+      free(queue->oz);
+      free(queue->dx);
+      free(queue->dy);
+      free(queue->dz);
+      free(queue->weight);
+      free(queue->budget);
+      free(queue->pixel);
+      free(queue->t);
+      free(queue->hit);
+      free(queue->hx);
+      free(queue->hy);
+      free(queue->hz);
+      free(queue->nx);
+      free(queue->ny);
+      free(queue->nz);
+      free(queue->spawn);
+   }
+   free(wave->shadows.dx);
+   free(wave->shadows.dy);
+   free(wave->shadows.dz);
+   free(wave->shadows.dist);
+   free(wave->shadows.occluded);
+   free(wave->colors);
+   free(wave->costs);
+   free(wave->occluders);
+   free(wave->keys);
+   free(wave->order);
+   memset(wave, 0, sizeof(wavefront));
+}
+
+// Method used to bound how much light a ray can still gather for adaptive
+// pruning. prune_bound[n] is the most a ray of weight 1 can add to or take
+// from its pixel when n more bounces may follow its own hit. Each light adds
+// at most 1 / a0, since shade_light clamps before falloff, and a hit passes at
+// most gain of its weight on to its secondary rays. A surface reflecting and
+// refracting more than it receives has a negative local weight, which only
+// flips signs, so the bound works on magnitudes and such scenes still prune.
+void prepare_prune(render_job *job)
+{
+   // Variable declarations
+   scene *scn = job->scn;
+   options *opts = job->opts;
+   double local = 0;
+   double gain = 0;
+   double spawn;
+
+   // Nothing to bound when every ray is traced
+   job->prune_bound = NULL;
+   if (opts->prune == PRUNE_OFF)
+   {
+      return;
+   }
+
+   // Direct light any single hit can gather. A spot light wider than a
+   // hemisphere can push a negative falloff, so saturated pixels only stop
+   // rays while every light adds something non-negative.
+   job->prune_saturated = TRUE;
+   for (int index = 0; index < scn->light_count; index++)
+   {
+      local += 1.0 / scn->lights[index].radial_a0;
+      if (scn->lights[index].spot == TRUE && scn->lights[index].cos_theta < 0)
+      {
+         job->prune_saturated = FALSE;
+      }
+   }
+
+   // Largest share of a hit's weight its secondary rays can carry, including
+   // the per-light repeats of the original shading
+   for (int index = 0; index < scn->spheres.count + scn->planes.count; index++)
+   {
+      // Variable declarations
+      material *mat = &(scn->materials[index]);
+
+      spawn = 1;
+      if (opts->shade_mode == SHADE_PER_LIGHT)
+      {
+         spawn = 0;
+         for (int cur_light = 0; cur_light < scn->light_count; cur_light++)
+         {
+            spawn = fabs(mat->local_weight) * spawn + 1;
+         }
+      }
+
+      // Light taken away can darken a white pixel again
+      if (mat->local_weight < 0)
+      {
+         job->prune_saturated = FALSE;
+      }
+      if (spawn * (mat->reflectivity + mat->refractivity) > gain)
+      {
+         gain = spawn * (mat->reflectivity + mat->refractivity);
+      }
+   }
+
+   // Build the bound up one bounce at a time
+   job->prune_bound = malloc(sizeof(double) * (opts->max_depth + 1));
+   job->prune_bound[0] = local;
+   for (int bounces = 1; bounces <= opts->max_depth; bounces++)
+   {
+      job->prune_bound[bounces] = local + gain * job->prune_bound[bounces - 1];
+   }
+}
+
+// Helper method used to make room for at least capacity rays in a queue
+void grow_rays(ray_queue *queue, int capacity)
+{
+   // Nothing to do if the queue is big enough
+   if (queue->capacity >= capacity)
+   {
+      return;
+   }
+
+   // Grow geometrically so a tile settles on its queue size quickly
+   if (capacity < 2 * queue->capacity)
+   {
+      capacity = 2 * queue->capacity;
+   }
+   queue->ox = realloc(queue->ox, sizeof(float) * capacity);
+   queue->oy = realloc(queue->oy, sizeof(float) * capacity);
+   queue->oz = realloc(queue->oz, sizeof(float) * capacity);
+   queue->dx = realloc(queue->dx, sizeof(float) * capacity);
+   queue->dy = realloc(queue->dy, sizeof(float) * capacity);
+   queue->dz = realloc(queue->dz, sizeof(float) * capacity);
+   queue->weight = realloc(queue->weight, sizeof(float) * capacity);
+   queue->budget = realloc(queue->budget, sizeof(float) * capacity);
+   queue->pixel = realloc(queue->pixel, sizeof(int) * capacity);
+   queue->t = realloc(queue->t, sizeof(float) * capacity);
+   queue->hit = realloc(queue->hit, sizeof(int) * capacity);
+   queue->hx = realloc(queue->hx, sizeof(float) * capacity);
+   queue->hy = realloc(queue->hy, sizeof(float) * capacity);
+   queue->hz = realloc(queue->hz, sizeof(float) * capacity);
+   queue->nx = realloc(queue->nx, sizeof(float) * capacity);
+   queue->ny = realloc(queue->ny, sizeof(float) * capacity);
+   queue->nz = realloc(queue->nz, sizeof(float) * capacity);
+   queue->spawn = realloc(queue->spawn, sizeof(float) * capacity);
+   queue->capacity = capacity;
+}
+
+// Helper method used to make room for at least capacity shadow rays
+void grow_shadows(shadow_queue *queue, int capacity)
+{
+   // Nothing to do if the queue is big enough
+   if (queue->capacity >= capacity)
+   {
+      return;
+   }
+
+   // Grow geometrically so a tile settles on its queue size quickly
+   if (capacity < 2 * queue->capacity)
+   {
+      capacity = 2 * queue->capacity;
+   }
+   queue->dx = realloc(queue->dx, sizeof(float) * capacity);
+   queue->dy = realloc(queue->dy, sizeof(float) * capacity);
+   queue->dz = realloc(queue->dz, sizeof(float) * capacity);
+   queue->dist = realloc(queue->dist, sizeof(float) * capacity);
+   queue->occluded = realloc(queue->occluded, sizeof(bool) * capacity);
+   queue->capacity = capacity;
+}
+
+// Helper method used to add a ray to the end of a queue with room for it
+void push_ray(ray_queue *queue, ib_v3 *r0, ib_v3 *rd, float weight, float budget, int pixel)
+{
+   // Variable declarations
+   int index = queue->count++;
+
+   queue->ox[index] = r0->x;
+   queue->oy[index] = r0->y;
+   queue->oz[index] = r0->z;
+   queue->dx[index] = rd->x;
+   queue->dy[index] = rd->y;
+   queue->dz[index] = rd->z;
+   queue->weight[index] = weight;
+   queue->budget[index] = budget;
+   queue->pixel[index] = pixel;
+}
+
+// Helper method used to queue one primary ray per pixel of a tile. Packets take
+// consecutive rays, so with packets on the rays are queued a block at a time.
+void generate_rays(render_job *job, wavefront *wave, tile *cur_tile)
+{
+   // Variable declarations
+   ray_queue *queue = &(wave->rays[0]);
+   int tile_width = cur_tile->x1 - cur_tile->x0;
+   int block_width = 1;
+   int block_height = 1;
+   ib_v3 rd;
+
+   // Every primary ray starts at the camera
+   queue->count = 0;
+   grow_rays(queue, tile_width * (cur_tile->y1 - cur_tile->y0));
+   if (job->opts->packet != PACKET_OFF)
+   {
+      packet_shape(job->opts->packet, &block_width, &block_height);
+   }
+
+   // Loop over the tile a block of pixels at a time, skipping pixels outside it
+   for (int y0 = cur_tile->y0; y0 < cur_tile->y1; y0 += block_height)
+   {
+      for (int x0 = cur_tile->x0; x0 < cur_tile->x1; x0 += block_width)
+      {
+         for (int y = y0; y < y0 + block_height && y < cur_tile->y1; y++)
+         {
+            for (int x = x0; x < x0 + block_width && x < cur_tile->x1; x++)
+            {
+               primary_ray(job, x, y, &rd);
+               push_ray(queue, &(job->frame->origin), &rd, 1, PRUNE_STEP, (y - cur_tile->y0) * tile_width + x - cur_tile->x0);
+            }
+         }
+      }
+   }
+}
+
+// Helper method used to find the closest hit of every ray in a queue, then drop
+// the rays that hit nothing. Primary rays go through packets when they are on,
+// or through the bvh subtrees the tile can reach.
+void extend_rays(render_job *job, wavefront *wave, ray_queue *queue, tile *cur_tile, int depth)
+{
+   // Variable declarations
+   tile_cone cone;
+   tile_entry entries[BVH_TILE_ENTRIES];
+   int entry_count;
+
+   // Primary rays of a packet all start at the camera
+   if (depth == 0 && job->opts->packet != PACKET_OFF)
+   {
+      extend_packets(job, wave, queue);
+   }
+   // Primary rays only need the parts of the bvh inside the tile's cone
+   else if (depth == 0)
+   {
+      tile_bounds(job, cur_tile, &cone);
+      entry_count = bvh_cone_entries(job->scn, &(job->frame->origin), &cone, entries);
+      for (int index = 0; index < queue->count; index++)
+      {
+         // Variable declarations
+         ib_v3 rd = { queue->dx[index], queue->dy[index], queue->dz[index] };
+         uint64_t start = heat_clock(job);
+
+         bvh_closest_entries(job->scn, job->frame, entries, entry_count, &rd, &(queue->t[index]), &(queue->hit[index]));
+         charge_cycles(job, wave, queue->pixel[index], start);
+      }
+   }
+   // Secondary rays walk the whole tree, in direction and origin order if asked
+   else
+   {
+      if (job->opts->sort == SORT_ON)
+      {
+         sort_rays(job, wave, queue->ox, queue->oy, queue->oz, queue->dx, queue->dy, queue->dz, queue->count);
+      }
+      for (int cur = 0; cur < queue->count; cur++)
+      {
+         // Variable declarations
+         int index = job->opts->sort == SORT_ON ? wave->order[cur] : cur;
+         ib_v3 r0 = { queue->ox[index], queue->oy[index], queue->oz[index] };
+         ib_v3 rd = { queue->dx[index], queue->dy[index], queue->dz[index] };
+         uint64_t start = heat_clock(job);
+
+         bvh_closest(job->scn, &r0, &rd, &(queue->t[index]), &(queue->hit[index]));
+         charge_cycles(job, wave, queue->pixel[index], start);
+      }
+   }
+
+   keep_hits(job->scn, queue);
+}
+
+// Helper method used to find the closest hits of the primary rays in a queue a
+// packet at a time
+void extend_packets(render_job *job, wavefront *wave, ray_queue *queue)
+{
+   // Variable declarations
+   ray_packet packet;
+   int lanes = job->opts->packet;
+   uint64_t start;
+   float cost;
+
+   // Every primary ray starts at the camera
+   packet.ox = job->frame->origin.x;
+   packet.oy = job->frame->origin.y;
+   packet.oz = job->frame->origin.z;
+
+   // Take the queue a packet of consecutive rays at a time
+   for (int first = 0; first < queue->count; first += lanes)
+   {
+      // Fill in every lane, switching off lanes past the end of the queue
+      for (int lane = 0; lane < lanes; lane++)
+      {
+         // Variable declarations
+         int index = first + lane < queue->count ? first + lane : first;
+
+         packet.active[lane] = first + lane < queue->count ? -1 : 0;
+         packet.dx[lane] = queue->dx[index];
+         packet.dy[lane] = queue->dy[index];
+         packet.dz[lane] = queue->dz[index];
+         packet.inv_dx[lane] = 1.0 / queue->dx[index];
+         packet.inv_dy[lane] = 1.0 / queue->dy[index];
+         packet.inv_dz[lane] = 1.0 / queue->dz[index];
+      }
+
+      // Find the first hit of the whole packet at once, sharing its cycles
+      // among the lanes in use
+      start = heat_clock(job);
+      packet_closest(job->scn, &packet, lanes);
+      cost = (float)(heat_clock(job) - start) / (queue->count - first < lanes ? queue->count - first : lanes);
+      for (int lane = 0; lane < lanes && first + lane < queue->count; lane++)
+      {
+         queue->t[first + lane] = packet.t[lane];
+         queue->hit[first + lane] = packet.hit[lane];
+         if (job->opts->heatmap == HEATMAP_CYCLES)
+         {
+            wave->costs[queue->pixel[first + lane]] += cost;
+         }
+      }
+   }
+}
+
+// Helper method used to drop the rays of a queue that hit nothing, and to find
+// the hit point and normal of the rest
+void keep_hits(scene *scn, ray_queue *queue)
+{
+   // Variable declarations
+   int kept = 0;
+   int hit;
+   ib_v3 ro;
+   ib_v3 ni;
+
+   for (int index = 0; index < queue->count; index++)
+   {
+      // Rays that miss add nothing to their pixel
+      if (queue->t[index] == INFINITY || queue->t[index] <= 0)
+      {
+         continue;
+      }
+
+      // Move the ray down over the ones dropped before it
+      queue->ox[kept] = queue->ox[index];
+      queue->oy[kept] = queue->oy[index];
+      queue->oz[kept] = queue->oz[index];
+      queue->dx[kept] = queue->dx[index];
+      queue->dy[kept] = queue->dy[index];
+      queue->dz[kept] = queue->dz[index];
+      queue->weight[kept] = queue->weight[index];
+      queue->budget[kept] = queue->budget[index];
+      queue->pixel[kept] = queue->pixel[index];
+      queue->t[kept] = queue->t[index];
+      queue->hit[kept] = hit = queue->hit[index];
+
+      // Create new r0 at the hit point
+      ro.x = (queue->t[kept] * queue->dx[kept]) + queue->ox[kept];
+      ro.y = (queue->t[kept] * queue->dy[kept]) + queue->oy[kept];
+      ro.z = (queue->t[kept] * queue->dz[kept]) + queue->oz[kept];
+
+      // If plane, store normal as N
+      if (hit >= scn->spheres.count)
+      {
+         ni.x = scn->planes.sx[hit - scn->spheres.count];
+         ni.y = scn->planes.sy[hit - scn->spheres.count];
+         ni.z = scn->planes.sz[hit - scn->spheres.count];
+      }
+      // If sphere, store difference between r0 and current object position
+      else
+      {
+         ni.x = ro.x - scn->spheres.x[hit];
+         ni.y = ro.y - scn->spheres.y[hit];
+         ni.z = ro.z - scn->spheres.z[hit];
+         ib_v3_normalize(&ni);
+      }
+
+      queue->hx[kept] = ro.x;
+      queue->hy[kept] = ro.y;
+      queue->hz[kept] = ro.z;
+      queue->nx[kept] = ni.x;
+      queue->ny[kept] = ni.y;
+      queue->nz[kept] = ni.z;
+      kept++;
+   }
+
+   queue->count = kept;
+}
+
+// Helper method used to queue a shadow ray from every hit towards every light,
+// then find which of them are blocked
+void cast_shadows(render_job *job, wavefront *wave, ray_queue *queue)
+{
+   // Variable declarations
+   scene *scn = job->scn;
+   shadow_queue *shadows = &(wave->shadows);
+   int index = 0;
+
+   // Start the thread with nothing cached for any light
+   if (wave->occluders == NULL)
+   {
+      wave->occluders = malloc(sizeof(int) * (scn->light_count > 0 ? scn->light_count : 1));
+      for (int cur_light = 0; cur_light < scn->light_count; cur_light++)
+      {
+         wave->occluders[cur_light] = -1;
+      }
+   }
+
+   // Lay the shadow rays out ray by ray, in light order
+   shadows->count = queue->count * scn->light_count;
+   grow_shadows(shadows, shadows->count);
+   STAT_ADD(shadow_rays, shadows->count);
+   for (int ray = 0; ray < queue->count; ray++)
+   {
+      for (int cur_light = 0; cur_light < scn->light_count; cur_light++, index++)
+      {
+         // Variable declarations
+         ib_v3 rdn;
+         float dist;
+
+         // Create new rd towards the light
+         rdn.x = scn->lights[cur_light].position.x - queue->hx[ray];
+         rdn.y = scn->lights[cur_light].position.y - queue->hy[ray];
+         rdn.z = scn->lights[cur_light].position.z - queue->hz[ray];
+
+         // Calculate distance
+         ib_v3_len(&dist, &rdn);
+         ib_v3_normalize(&rdn);
+         shadows->dx[index] = rdn.x;
+         shadows->dy[index] = rdn.y;
+         shadows->dz[index] = rdn.z;
+         shadows->dist[index] = dist;
+      }
+   }
+
+   // Sorted, each light's rays are tested together in the order of their origins
+   if (job->opts->sort == SORT_ON)
+   {
+      sort_rays(job, wave, queue->hx, queue->hy, queue->hz, NULL, NULL, NULL, queue->count);
+      for (int cur_light = 0; cur_light < scn->light_count; cur_light++)
+      {
+         for (int cur = 0; cur < queue->count; cur++)
+         {
+            // Variable declarations
+            uint64_t start = heat_clock(job);
+
+            test_shadow(scn, wave, queue, wave->order[cur], cur_light);
+            charge_cycles(job, wave, queue->pixel[wave->order[cur]], start);
+         }
+      }
+   }
+   // Otherwise, every ray's lights are tested in turn
+   else
+   {
+      for (int ray = 0; ray < queue->count; ray++)
+      {
+         for (int cur_light = 0; cur_light < scn->light_count; cur_light++)
+         {
+            // Variable declarations
+            uint64_t start = heat_clock(job);
+
+            test_shadow(scn, wave, queue, ray, cur_light);
+            charge_cycles(job, wave, queue->pixel[ray], start);
+         }
+      }
+   }
+}
+
+// Helper method used to test the shadow ray of a hit towards one light against
+// everything but the surface it leaves. Neighbouring hits are usually shadowed
+// by the same object, so the last object found blocking the light is tried on
+// its own before walking the bvh.
+void test_shadow(scene *scn, wavefront *wave, ray_queue *queue, int ray, int cur_light)
+{
+   // Variable declarations
+   shadow_queue *shadows = &(wave->shadows);
+   int index = ray * scn->light_count + cur_light;
+   ib_v3 ro = { queue->hx[ray], queue->hy[ray], queue->hz[ray] };
+   ib_v3 rdn = { shadows->dx[index], shadows->dy[index], shadows->dz[index] };
+   int *cached = &(wave->occluders[cur_light]);
+   int blocker;
+
+   // Try the cached occluder first, unless it is the surface itself
+   if (*cached >= 0 && *cached != queue->hit[ray])
+   {
+      STAT_ADD(cache_tests, 1);
+      if (primitive_occludes(scn, *cached, &ro, &rdn, shadows->dist[index]) == TRUE)
+      {
+         STAT_ADD(cache_hits, 1);
+         shadows->occluded[index] = TRUE;
+         return;
+      }
+   }
+
+   // Otherwise, walk the bvh and remember whatever blocks the light
+   shadows->occluded[index] = shadowed(&ro, &rdn, &(shadows->dist[index]), &(queue->hit[ray]), scn, &blocker);
+   if (blocker >= 0)
+   {
+      *cached = blocker;
+   }
+}
+
+// Helper method used to add the direct light of every hit to its pixel, and to
+// work out the weight its reflection and refraction rays are seen with.
+// Tracing the secondary rays again after every visible light, as the original
+// path does, scales their color by 1 + w + w^2 + ... for local weight w, so they
+// are traced once with that weight instead.
+void shade_rays(scene *scn, options *opts, wavefront *wave, ray_queue *queue)
+{
+   // Variable declarations
+   shadow_queue *shadows = &(wave->shadows);
+   int index = 0;
+
+   for (int ray = 0; ray < queue->count; ray++)
+   {
+      // Variable declarations
+      material *closest = &(scn->materials[queue->hit[ray]]);
+      ib_v3 rd = { queue->dx[ray], queue->dy[ray], queue->dz[ray] };
+      ib_v3 ni = { queue->nx[ray], queue->ny[ray], queue->nz[ray] };
+      rgb local = { 0, 0, 0 };
+      rgb *color = &(wave->colors[queue->pixel[ray]]);
+      float spawn = opts->shade_mode == SHADE_ONCE ? 1 : 0;
+
+      // Loop through lights in array
+      for (int cur_light = 0; cur_light < scn->light_count; cur_light++, index++)
+      {
+         // Variable declarations
+         ib_v3 rdn = { shadows->dx[index], shadows->dy[index], shadows->dz[index] };
+         rgb direct;
+
+         // Skip light if current object is in shadow of another
+         if (shadows->occluded[index] == TRUE)
+         {
+            continue;
+         }
+
+         // Add the diffuse and specular values of this light
+         direct = shade_light(&(scn->lights[cur_light]), closest, &ni, &rd, &rdn, shadows->dist[index]);
+         local.r += direct.r;
+         local.g += direct.g;
+         local.b += direct.b;
+
+         // Original path blends in the secondary rays again for every visible light
+         if (opts->shade_mode == SHADE_PER_LIGHT)
+         {
+            local.r = closest->local_weight * local.r;
+            local.g = closest->local_weight * local.g;
+            local.b = closest->local_weight * local.b;
+            spawn = closest->local_weight * spawn + 1;
+         }
+      }
+
+      // Otherwise, the direct light is blended in once
+      if (opts->shade_mode == SHADE_ONCE)
+      {
+         local.r = closest->local_weight * local.r;
+         local.g = closest->local_weight * local.g;
+         local.b = closest->local_weight * local.b;
+      }
+
+      // Add what this hit contributes to its pixel
+      color->r += queue->weight[ray] * local.r;
+      color->g += queue->weight[ray] * local.g;
+      color->b += queue->weight[ray] * local.b;
+      queue->spawn[ray] = queue->weight[ray] * spawn;
+   }
+}
+
+// Helper method used to queue the reflection and refraction rays of every hit
+// that still contributes to its pixel
+void spawn_rays(render_job *job, wavefront *wave, ray_queue *queue, ray_queue *next, int depth)
+{
+   // Variable declarations
+   scene *scn = job->scn;
+
+   // Each hit spawns at most two rays
+   grow_rays(next, 2 * queue->count);
+
+   for (int ray = 0; ray < queue->count; ray++)
+   {
+      // Variable declarations
+      material *mat = &(scn->materials[queue->hit[ray]]);
+      ib_v3 rd = { queue->dx[ray], queue->dy[ray], queue->dz[ray] };
+      ib_v3 ni = { queue->nx[ray], queue->ny[ray], queue->nz[ray] };
+      ib_v3 new_r0 = { queue->hx[ray], queue->hy[ray], queue->hz[ray] };
+      ib_v3 new_rd;
+      ib_v3 offset;
+      float share;
+
+      // A surface in full shadow gets no reflection or refraction on the original path
+      if (queue->spawn[ray] == 0)
+      {
+         continue;
+      }
+
+      // Split the ray's error budget between its reflection and refraction in
+      // proportion to their weights, so what both may leave out adds up to it
+      share = queue->budget[ray] / (mat->reflectivity + mat->refractivity);
+
+      // If reflectivity, calculate it
+      if (mat->reflectivity > 0)
+      {
+         // Generate reflection value
+         float nrd;
+         ib_v3_dot(&nrd, &ni, &rd);
+         new_rd.x = rd.x - 2 * nrd * ni.x;
+         new_rd.y = rd.y - 2 * nrd * ni.y;
+         new_rd.z = rd.z - 2 * nrd * ni.z;
+
+         // Calculte offset so object doesn't intersect with itself
+         offset.x = new_rd.x * WAVE_OFFSET;
+         offset.y = new_rd.y * WAVE_OFFSET;
+         offset.z = new_rd.z * WAVE_OFFSET;
+         new_r0.x = new_r0.x + offset.x;
+         new_r0.y = new_r0.y + offset.y;
+         new_r0.z = new_r0.z + offset.z;
+         ib_v3_normalize(&new_rd);
+
+         if (prune_ray(job, wave, queue->spawn[ray] * mat->reflectivity, share * mat->reflectivity, queue->pixel[ray], depth + 1) == FALSE)
+         {
+            push_ray(next, &new_r0, &new_rd, queue->spawn[ray] * mat->reflectivity, share * mat->reflectivity, queue->pixel[ray]);
+         }
+      }
+
+      // If refractivity, calculate it. The origin keeps the reflection offset,
+      // and the ray bends as if entering the surface, as they always have.
+      if (mat->refractivity > 0)
+      {
+         // Variable declarations
+         ib_v3 a;
+         ib_v3 b;
+         float sinP;
+         float cosP;
+
+         // Set a
+         a.x = ni.y * rd.z - ni.z * rd.y;
+         a.y = ni.z * rd.x - ni.x * rd.z;
+         a.z = ni.x * rd.y - ni.y * rd.x;
+         ib_v3_normalize(&a);
+
+         // Set b
+         b.x = a.y * ni.z - a.z * ni.y;
+         b.y = a.z * ni.x - a.x * ni.z;
+         b.z = a.x * ni.y - a.y * ni.x;
+         ib_v3_normalize(&b);
+
+         // Set sin and cos values
+         sinP = mat->ior * (rd.x * b.x + rd.y * b.y + rd.z * b.z);
+         cosP = sqrt(1 - (sinP * sinP));
+
+         // Set new rd value
+         new_rd.x = -(ni.x) * cosP + b.x * sinP;
+         new_rd.y = -(ni.y) * cosP + b.y * sinP;
+         new_rd.z = -(ni.z) * cosP + b.z * sinP;
+
+         // Calculte offset so object doesn't intersect with itself
+         offset.x = new_rd.x * WAVE_OFFSET;
+         offset.y = new_rd.y * WAVE_OFFSET;
+         offset.z = new_rd.z * WAVE_OFFSET;
+         new_r0.x = new_r0.x + offset.x;
+         new_r0.y = new_r0.y + offset.y;
+         new_r0.z = new_r0.z + offset.z;
+         ib_v3_normalize(&new_rd);
+
+         if (prune_ray(job, wave, queue->spawn[ray] * mat->refractivity, share * mat->refractivity, queue->pixel[ray], depth + 1) == FALSE)
+         {
+            push_ray(next, &new_r0, &new_rd, queue->spawn[ray] * mat->refractivity, share * mat->refractivity, queue->pixel[ray]);
+         }
+      }
+   }
+}
+
+// Helper method used to decide whether a secondary ray at depth with weight can
+// be skipped. With adaptive pruning on, a ray is cut when all it could ever add
+// stays under its share of the budget, or when its pixel is already white and
+// can only be clamped back. Every pixel starts with half a step of the 8-bit
+// output and the shares of a hit's rays add up to its own, so all the rays cut
+// from one pixel together stay under half a step.
+bool prune_ray(render_job *job, wavefront *wave, float weight, float budget, int pixel, int depth)
+{
+   // Variable declarations
+   rgb *color = &(wave->colors[pixel]);
+
+   // Every ray is traced unless asked otherwise
+   if (job->opts->prune == PRUNE_OFF)
+   {
+      return FALSE;
+   }
+
+   // Cut the ray if it cannot change the pixel
+   if (fabsf(weight) * job->prune_bound[job->opts->max_depth - depth] < budget ||
+       (job->prune_saturated == TRUE && color->r >= 1 && color->g >= 1 && color->b >= 1))
+   {
+      STAT_ADD(pruned_rays, 1);
+      return TRUE;
+   }
+
+   return FALSE;
+}
+
+// Helper method used to add amount to the heatmap cost of every ray's pixel in a queue
+void charge_rays(wavefront *wave, ray_queue *queue, float amount)
+{
+   for (int ray = 0; ray < queue->count; ray++)
+   {
+      wave->costs[queue->pixel[ray]] += amount;
+   }
+}
+
+// Helper method used to read the time stamp counter when the heatmap counts
+// cycles, so the other modes never pay for it
+uint64_t heat_clock(render_job *job)
+{
+   return job->opts->heatmap == HEATMAP_CYCLES ? __rdtsc() : 0;
+}
+
+// Helper method used to add the cycles since start to the heatmap cost of a pixel
+void charge_cycles(render_job *job, wavefront *wave, int pixel, uint64_t start)
+{
+   if (job->opts->heatmap == HEATMAP_CYCLES)
+   {
+      wave->costs[pixel] += __rdtsc() - start;
+   }
+}
+
+// Helper method used to order count rays for coherent traversal, leaving the
+// order in wave->order. Rays are grouped by the octant of their direction,
+// when given, then by a Morton code of their origin within the bvh bounds, so
+// rays that start close together and head the same way are traced together.
+// The queue itself is left as it is, so pixels still add up in the same order.
+void sort_rays(render_job *job, wavefront *wave, float *x, float *y, float *z, float *dx, float *dy, float *dz, int count)
+{
+   // Variable declarations
+   bvh *tree = &(job->scn->tree);
+   float cells = (1 << SORT_MORTON_BITS) - 1;
+   ib_v3 low = { 0, 0, 0 };
+   ib_v3 scale = { 0, 0, 0 };
+
+   // Make room for a key per ray
+   if (wave->order_capacity < count)
+   {
+      free(wave->keys);
+      free(wave->order);
+      wave->keys = malloc(sizeof(uint64_t) * count);
+      wave->order = malloc(sizeof(int) * count);
+      wave->order_capacity = count;
+   }
+
+   // Map the bvh bounds onto the Morton grid; points outside are clamped to its edge
+   if (tree->node_count > 0)
+   {
+      low = tree->nodes[0].bounds.min;
+      scale.x = cells / fmaxf(tree->nodes[0].bounds.max.x - low.x, 1e-6);
+      scale.y = cells / fmaxf(tree->nodes[0].bounds.max.y - low.y, 1e-6);
+      scale.z = cells / fmaxf(tree->nodes[0].bounds.max.z - low.z, 1e-6);
+   }
+
+   for (int index = 0; index < count; index++)
+   {
+      // Variable declarations
+      uint32_t cell_x = (uint32_t)clamp((x[index] - low.x) * scale.x, 0, cells);
+      uint32_t cell_y = (uint32_t)clamp((y[index] - low.y) * scale.y, 0, cells);
+      uint32_t cell_z = (uint32_t)clamp((z[index] - low.z) * scale.z, 0, cells);
+      uint64_t code = spread_bits(cell_x) | spread_bits(cell_y) << 1 | spread_bits(cell_z) << 2;
+
+      // Put the direction octant above the Morton code
+      if (dx != NULL)
+      {
+         code |= (uint64_t)((dx[index] < 0) | (dy[index] < 0) << 1 | (dz[index] < 0) << 2) << (3 * SORT_MORTON_BITS);
+      }
+
+      // Keep the index in the low bits so equal codes stay in queue order
+      wave->keys[index] = code << SORT_INDEX_BITS | (uint32_t)index;
+   }
+
+   // Sort, then read the ray indices back out
+   qsort(wave->keys, count, sizeof(uint64_t), compare_keys);
+   for (int index = 0; index < count; index++)
+   {
+      wave->order[index] = (int)(wave->keys[index] & UINT32_MAX);
+   }
+}
+
+// Helper method used to spread the low bits of a value out to every third bit
+uint32_t spread_bits(uint32_t value)
+{
+   value &= 0x3ff;
+   value = (value | value << 16) & 0x030000ff;
+   value = (value | value << 8) & 0x0300f00f;
+   value = (value | value << 4) & 0x030c30c3;
+   value = (value | value << 2) & 0x09249249;
+
+   return value;
+}
+
+// Helper method used to compare two sort keys for qsort
+int compare_keys(const void *a, const void *b)
+{
+   // Variable declarations
+   uint64_t first = *(const uint64_t *)a;
+   uint64_t second = *(const uint64_t *)b;
+
+   return (first > second) - (first < second);
+}
@@ -0,0 +1,16 @@
+#ifndef WAVEFRONT
+#define WAVEFRONT
+
+#include "raycast.h"
+
+#define WAVE_OFFSET 0.0001
+#define PRUNE_STEP (0.5 / 255)
+#define SORT_MORTON_BITS 9
+#define SORT_INDEX_BITS 32
+
+// Public function declarations
+void trace_tile(worker *self, tile *cur_tile);
+void free_wavefront(wavefront *wave);
+void prepare_prune(render_job *job);
+
+#endif